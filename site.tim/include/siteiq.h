@@ -0,0 +1,41 @@
+/* siteiq.h
+   ========
+*/
+
+
+#ifndef _SITEIQ_H
+#define _SITEIQ_H
+
+/* Layout of the IQ shared memory segment.
+ *
+ * By default the segment holds interleaved int16 I/Q samples, main
+ * followed by back for each sequence, exactly as before. When the site
+ * is configured for the planar layout the segment starts with this
+ * descriptor, padded to SITEIQ_ALIGN bytes, and each sequence is stored
+ * as four planes of plane samples each: main I, main Q, back I, back Q.
+ * Every plane starts on a SITEIQ_ALIGN byte boundary. seqoff and seqsze
+ * still give the position and length of each sequence in int16 units
+ * from the start of the segment.
+ */
+
+#define SITEIQ_MAGIC 0x51495153 /* "SQIQ" */
+#define SITEIQ_VERSION 1
+
+#define SITEIQ_INTERLEAVED 0
+#define SITEIQ_PLANAR 1
+
+#define SITEIQ_ALIGN 64
+
+struct SiteIQHeader {
+  int32 magic;
+  int32 version;
+  int32 layout;
+  int32 hdrsze;  /* bytes before the first sequence */
+  int32 plane;   /* int16 samples per plane */
+  int32 seqnum;  /* sequences stored so far in this integration */
+  int32 smpnum;  /* samples used per sequence */
+  int32 chnnum;  /* receiver channels per sequence */
+  int32 spare[8];
+};
+
+#endif
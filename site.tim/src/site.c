@@ -12,11 +12,15 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <semaphore.h>
 #include <errno.h>
 #include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include <libconfig.h>
 #include "rtypes.h"
@@ -31,6 +35,18 @@
 #include "global.h"
 #include "site.h"
 #include "siteglobal.h"
+#include "sitedecode.h"
+#include "siteiq.h"
+#include "sitelag.h"
+#include "sitepool.h"
+#include "siteacfex.h"
+#include "sitescreen.h"
+#include "siteplan.h"
+#include "sitetsg.h"
+#include "sitemsg.h"
+#include "sitemem.h"
+#include "sitering.h"
+#include "sitelink.h"
 
 #define REAL_BUF_OFFSET 0
 #define IMAG_BUF_OFFSET 1
@@ -47,6 +63,9 @@ FILE *seqlog=NULL;
 char seqlog_name[256];
 char *seqlog_dir=NULL;
 
+FILE *seqstat=NULL;
+char seqstat_name[256];
+
 FILE *msglog=NULL;
 char msglog_name[256];
 char *msglog_dir=NULL;
@@ -55,6 +74,62 @@ FILE *f_diagnostic_ascii=NULL,*fp=NULL;
 
 int yday=-1;
 int iqbufsize=0;
+int rossmp=0; /* samples to request from the ROS, 0 until the lag table is known */
+
+struct SiteTimDecoder decoder;
+struct SiteTimLagAcc lagacc; /* integration sums laid out for the sequence */
+
+int iqlayout=SITEIQ_INTERLEAVED; /* layout requested in the site cfg */
+struct SiteIQHeader *iqhdr=NULL; /* descriptor at the head of a planar segment */
+
+int acfexstream=0; /* ACFEX sums as each sequence arrives, 1 to check, 2 to use */
+struct SiteTimACFex acfex;
+
+struct SiteTimScreen screen; /* sequence rejection limits from the site cfg */
+
+struct SiteTimPlan plan; /* integration set up for the registered sequence */
+
+float xcfgate=0; /* XCF only for gates this far above the noise, 0 for all */
+int xcfgateseq=3; /* sequences summed before the gates are chosen */
+unsigned char xgate[MAX_RANGE];
+float xgatepwr[MAX_RANGE];
+
+int seqmax=SITE_SEQ_MAX; /* sequences held on the ROS at once */
+char seqdir[256]=""; /* disk copies of the sequences, empty for none */
+
+struct SiteTimLink roslink; /* transport to the ROS */
+int datachan=1; /* ask the ROS for a separate connection for the samples */
+int dsock=0; /* connection the samples come on, sock unless separate */
+int rospipe=1; /* send each sequence's requests ahead of the replies */
+int datastatus=0; /* the ROS ends each data reply with SiteTimDataStatus */
+int waitdata=0; /* the ROS answers WAIT_FOR_DATA once the samples are in */
+int waitslack=100000; /* usec allowed past the sequence before giving up */
+struct ControlPRM prmwant; /* parameters the library asks the ROS for */
+struct ControlPRM prmlast; /* parameters the ROS last took */
+int prmok=0;
+
+int seqbadmax[MAXNAVE]; /* bad TR entries room is kept for in seqbadtr */
+int patmax=0; /* pulses room is kept for in tsgprm.pat */
+
+int seqpipe=0; /* decode and sum on a worker while the next sequence runs */
+struct SiteTimRing ring;
+
+/* integration state carried from one sequence to the next */
+static struct SiteTimSeqState {
+  int nave,ndrop;
+  int iqoff,iqsze;
+  int planar,plane,step;
+  int acfsmp;
+  int farsmp,farnum;
+  int xgated;
+  int *lagtable[2];
+  int badrng;
+  int atstp;
+  int pooled; /* gates shared between the lag pool threads */
+  int streamed; /* ACFEX summed as each sequence arrives */
+} seqstate;
+
+static void SiteTimSlotProcess(struct SiteTimSlot *rx);
 
 void SiteTimExit(int signum) {
 
@@ -76,12 +151,17 @@ void SiteTimExit(int signum) {
           fprintf(stderr,"QUIT:type=%c\n",msg.type);
           fprintf(stderr,"QUIT:status=%d\n",msg.status);
         }
+        if ((dsock>0) && (dsock !=sock)) close(dsock);
         close(sock);
         if(seqlog!=NULL) {
           fflush(seqlog);
           fclose(seqlog);
           seqlog=NULL;
         } 
+        if(seqstat!=NULL) {
+          fclose(seqstat);
+          seqstat=NULL;
+        } 
         if(msglog!=NULL) {
           fclose(msglog);
           msglog=NULL;
@@ -108,12 +188,17 @@ void SiteTimExit(int signum) {
           fprintf(stderr,"QUIT:type=%c\n",msg.type);
           fprintf(stderr,"QUIT:status=%d\n",msg.status);
         }
+        if ((dsock>0) && (dsock !=sock)) close(dsock);
         close(sock);
         if(seqlog!=NULL) {
           fflush(seqlog);
           fclose(seqlog);
           seqlog=NULL;
         } 
+        if(seqstat!=NULL) {
+          fclose(seqstat);
+          seqstat=NULL;
+        } 
         if(msglog!=NULL) {
           fclose(msglog);
           msglog=NULL;
@@ -137,6 +222,7 @@ void SiteTimExit(int signum) {
 int SiteTimStart(char *host,char *ststr) {
   int retval;
   long ltemp;
+  double dtemp;
   const char *str;
   char *dfststr="tst";
   char *chanstr=NULL;
@@ -148,6 +234,7 @@ int SiteTimStart(char *host,char *ststr) {
     seqbadtr[nave].num=0;
     seqbadtr[nave].start=NULL;
     seqbadtr[nave].length=NULL;
+    seqbadmax[nave]=0;
   }
   nave=0;
   rdata.main=NULL;
@@ -156,6 +243,7 @@ int SiteTimStart(char *host,char *ststr) {
   badtrdat.duration_usec=NULL;
   tsgbuf=NULL;
   tsgprm.pat=NULL;
+  patmax=0;
   samples=NULL;
   exit_flag=0;
   cancel_count=0;
@@ -271,6 +359,50 @@ int SiteTimStart(char *host,char *ststr) {
   } else {
     port=ltemp;
   }
+  if(! config_lookup_string(&cfg, "ros.transport", &str)) {
+    /* Connection to the ROS: tcp, unix or shm */
+    roslink.type=SITELINK_TCP;
+    fprintf(stderr,"Site Cfg Warning:: \'ros.transport\' setting undefined in site cfg file using default value: \'%s\'\n",SiteTimLinkName(roslink.type)); 
+  } else {
+    roslink.type=SiteTimLinkType(str);
+    if (roslink.type<0) {
+      fprintf(stderr,"Site Cfg Warning:: \'ros.transport\' setting \'%s\' unknown in site cfg file using default value: \'tcp\'\n",str); 
+      roslink.type=SITELINK_TCP;
+    } else fprintf(stderr,"Site Cfg:: \'ros.transport\' setting in site cfg file using value: \'%s\'\n",SiteTimLinkName(roslink.type)); 
+  }
+  if(! config_lookup_string(&cfg, "ros.socket", &str)) {
+    /* ROS server unix socket, used with the unix and shm transports */
+    strcpy(roslink.path,"/tmp/usrp_server.sock");
+    if (roslink.type !=SITELINK_TCP) fprintf(stderr,"Site Cfg Warning:: \'ros.socket\' setting undefined in site cfg file using default value: \'%s\'\n",roslink.path); 
+  } else {
+    strncpy(roslink.path,str,sizeof(roslink.path)-1);
+    roslink.path[sizeof(roslink.path)-1]=0;
+    fprintf(stderr,"Site Cfg:: \'ros.socket\' setting in site cfg file using value: \'%s\'\n",roslink.path); 
+  }
+  if(! config_lookup_int(&cfg, "ros.data_channel", &ltemp)) {
+    /* Samples on a second connection when the ROS offers one */
+    datachan=1;
+    fprintf(stderr,"Site Cfg Warning:: \'ros.data_channel\' setting undefined in site cfg file using default value: %d\n",datachan); 
+  } else {
+    datachan=ltemp;
+    fprintf(stderr,"Site Cfg:: \'ros.data_channel\' setting in site cfg file using value: %d\n",datachan); 
+  }
+  if(! config_lookup_int(&cfg, "ros.wait_slack", &ltemp)) {
+    /* Time past the end of the samples the ROS waits for them, usec */
+    waitslack=100000;
+    fprintf(stderr,"Site Cfg Warning:: \'ros.wait_slack\' setting undefined in site cfg file using default value: %d\n",waitslack); 
+  } else {
+    waitslack=ltemp;
+    fprintf(stderr,"Site Cfg:: \'ros.wait_slack\' setting in site cfg file using value: %d\n",waitslack); 
+  }
+  if(! config_lookup_int(&cfg, "ros.pipeline", &ltemp)) {
+    /* Requests sent ahead of the replies within a sequence */
+    rospipe=1;
+    fprintf(stderr,"Site Cfg Warning:: \'ros.pipeline\' setting undefined in site cfg file using default value: %d\n",rospipe); 
+  } else {
+    rospipe=ltemp;
+    fprintf(stderr,"Site Cfg:: \'ros.pipeline\' setting in site cfg file using value: %d\n",rospipe); 
+  }
   if(! config_lookup_int(&cfg, "errlog.port", &ltemp)) {
     /* ROS server tcp port*/
     errlog.port=45000;
@@ -352,23 +484,234 @@ int SiteTimStart(char *host,char *ststr) {
     nfrq=ltemp;
     fprintf(stderr,"Site Cfg:: \'nfrq\' setting in site cfg file using value: %d\n",nfrq); 
   }
+  if(! config_lookup_int(&cfg, "pcode_fft", &ltemp)) {
+/* Phase codes with more chips than this are decoded by FFT correlation, 0 disables */
+    ltemp=64;
+    fprintf(stderr,"Site Cfg Warning:: \'pcode_fft\' setting undefined in site cfg file using default value: %ld\n",ltemp); 
+  } else {
+    fprintf(stderr,"Site Cfg:: \'pcode_fft\' setting in site cfg file using value: %ld\n",ltemp); 
+  }
+  SiteTimDecodeFFTThreshold(ltemp);
+  if(! config_lookup_string(&cfg, "iq_layout", &str)) {
+/* Sample layout of the IQ shared memory, interleaved or planar */
+    iqlayout=SITEIQ_INTERLEAVED;
+    fprintf(stderr,"Site Cfg Warning:: \'iq_layout\' setting undefined in site cfg file using default value: interleaved\n"); 
+  } else {
+    if (strcmp(str,"planar")==0) iqlayout=SITEIQ_PLANAR;
+    else iqlayout=SITEIQ_INTERLEAVED;
+    fprintf(stderr,"Site Cfg:: \'iq_layout\' setting in site cfg file using value: %s\n",
+            (iqlayout==SITEIQ_PLANAR) ? "planar" : "interleaved"); 
+  }
+  fprintf(stderr,"Site:: phase code decoder using %s kernel\n",
+          SiteTimDecodeName(SiteTimDecodeInit()));
+  SiteTimDecodeSelect(&decoder,NULL,1);
+  fprintf(stderr,"Site:: lag products using %s kernel\n",
+          SiteTimLagName(SiteTimLagInit()));
+  if(! config_lookup_int(&cfg, "acf_threads", &ltemp)) {
+/* Threads sharing the range gates of the lag products, 1 keeps it all on the control thread */
+    ltemp=1;
+    fprintf(stderr,"Site Cfg Warning:: \'acf_threads\' setting undefined in site cfg file using default value: %ld\n",ltemp); 
+  } else {
+    fprintf(stderr,"Site Cfg:: \'acf_threads\' setting in site cfg file using value: %ld\n",ltemp); 
+  }
+  if (ltemp>1) fprintf(stderr,"Site:: lag products shared across %d threads\n",
+                       SiteTimPoolStart(ltemp));
+  if(! config_lookup_int(&cfg, "acfex_stream", &ltemp)) {
+/* Fold each sequence into the ACFEX sums as it arrives, 1 checks them against ACFexCalculate, 2 uses them in its place */
+    acfexstream=0;
+    fprintf(stderr,"Site Cfg Warning:: \'acfex_stream\' setting undefined in site cfg file using default value: %d\n",acfexstream); 
+  } else {
+    acfexstream=ltemp;
+    fprintf(stderr,"Site Cfg:: \'acfex_stream\' setting in site cfg file using value: %d\n",acfexstream); 
+  }
+  if(! config_lookup_int(&cfg, "screen_level", &ltemp)) {
+/* I or Q magnitude counted as a clipped sample */
+    screen.level=32767;
+    fprintf(stderr,"Site Cfg Warning:: \'screen_level\' setting undefined in site cfg file using default value: %d\n",screen.level); 
+  } else {
+    screen.level=ltemp;
+    fprintf(stderr,"Site Cfg:: \'screen_level\' setting in site cfg file using value: %d\n",screen.level); 
+  }
+  if(! config_lookup_int(&cfg, "screen_peak", &ltemp)) {
+/* Drop sequences whose peak I or Q magnitude is above this, 0 disables */
+    screen.peak=0;
+    fprintf(stderr,"Site Cfg Warning:: \'screen_peak\' setting undefined in site cfg file using default value: %d\n",screen.peak); 
+  } else {
+    screen.peak=ltemp;
+    fprintf(stderr,"Site Cfg:: \'screen_peak\' setting in site cfg file using value: %d\n",screen.peak); 
+  }
+  if(! config_lookup_int(&cfg, "screen_clip", &ltemp)) {
+/* Drop sequences with more clipped I or Q components than this, 0 disables */
+    screen.clip=0;
+    fprintf(stderr,"Site Cfg Warning:: \'screen_clip\' setting undefined in site cfg file using default value: %d\n",screen.clip); 
+  } else {
+    screen.clip=ltemp;
+    fprintf(stderr,"Site Cfg:: \'screen_clip\' setting in site cfg file using value: %d\n",screen.clip); 
+  }
+  if(! config_lookup_float(&cfg, "screen_noise", &dtemp)) {
+/* Drop sequences whose median far range power is above this, 0 disables */
+    screen.noise=0;
+    fprintf(stderr,"Site Cfg Warning:: \'screen_noise\' setting undefined in site cfg file using default value: %g\n",screen.noise); 
+  } else {
+    screen.noise=dtemp;
+    fprintf(stderr,"Site Cfg:: \'screen_noise\' setting in site cfg file using value: %g\n",screen.noise); 
+  }
+  if(! config_lookup_int(&cfg, "screen_far", &ltemp)) {
+/* Number of far ranges the median power is taken over */
+    screen.nfar=10;
+    fprintf(stderr,"Site Cfg Warning:: \'screen_far\' setting undefined in site cfg file using default value: %d\n",screen.nfar); 
+  } else {
+    screen.nfar=ltemp;
+    fprintf(stderr,"Site Cfg:: \'screen_far\' setting in site cfg file using value: %d\n",screen.nfar); 
+  }
+  screen.on=(screen.peak>0) || (screen.clip>0) || (screen.noise>0);
+  if(! config_lookup_float(&cfg, "xcf_gate", &dtemp)) {
+/* XCF only for gates whose lag-0 power is this many times the noise, 0 for every gate */
+    xcfgate=0;
+    fprintf(stderr,"Site Cfg Warning:: \'xcf_gate\' setting undefined in site cfg file using default value: %g\n",xcfgate); 
+  } else {
+    xcfgate=dtemp;
+    fprintf(stderr,"Site Cfg:: \'xcf_gate\' setting in site cfg file using value: %g\n",xcfgate); 
+  }
+  if(! config_lookup_int(&cfg, "xcf_gate_seq", &ltemp)) {
+/* Sequences of full XCF before the gates are chosen */
+    xcfgateseq=3;
+    fprintf(stderr,"Site Cfg Warning:: \'xcf_gate_seq\' setting undefined in site cfg file using default value: %d\n",xcfgateseq); 
+  } else {
+    xcfgateseq=ltemp;
+    fprintf(stderr,"Site Cfg:: \'xcf_gate_seq\' setting in site cfg file using value: %d\n",xcfgateseq); 
+  }
+  if (xcfgateseq<1) xcfgateseq=1;
+  if(! config_lookup_int(&cfg, "tsg_cache", &ltemp)) {
+/* Pulse sequences registered with the ROS at once, 1 for index 0 only */
+    seqmax=SITE_SEQ_MAX;
+    fprintf(stderr,"Site Cfg Warning:: \'tsg_cache\' setting undefined in site cfg file using default value: %d\n",seqmax); 
+  } else {
+    seqmax=ltemp;
+    fprintf(stderr,"Site Cfg:: \'tsg_cache\' setting in site cfg file using value: %d\n",seqmax); 
+  }
+  if(! config_lookup_string(&cfg, "tsg_cache_dir", &str)) {
+/* Directory keeping the sequences between runs, none by default */
+    seqdir[0]=0;
+    fprintf(stderr,"Site Cfg Warning:: \'tsg_cache_dir\' setting undefined in site cfg file using default value: \'%s\'\n",seqdir); 
+  } else {
+    strncpy(seqdir,str,sizeof(seqdir)-1);
+    seqdir[sizeof(seqdir)-1]=0;
+    fprintf(stderr,"Site Cfg:: \'tsg_cache_dir\' setting in site cfg file using value: \'%s\'\n",seqdir); 
+  }
+  SiteTimSeqConfig(seqmax,seqdir);
+  if(! config_lookup_int(&cfg, "seq_pipeline", &ltemp)) {
+/* Sequences are decoded and summed on the control thread */
+    seqpipe=0;
+    fprintf(stderr,"Site Cfg Warning:: \'seq_pipeline\' setting undefined in site cfg file using default value: %d\n",seqpipe); 
+  } else {
+    seqpipe=ltemp;
+    fprintf(stderr,"Site Cfg:: \'seq_pipeline\' setting in site cfg file using value: %d\n",seqpipe); 
+  }
+  if (SiteTimRingStart(&ring,SiteTimSlotProcess,seqpipe) !=0) {
+    fprintf(stderr,"Site Cfg:: sequence worker unavailable, not pipelining\n");
+    seqpipe=0;
+  }
+  if (screen.on) fprintf(stderr,"Site:: sequence screening using %s kernel\n",
+                         SiteTimDecodeName(SiteTimDecodeInit()));
   return 0;
 }
 
 
-int SiteTimSetupRadar() {
+/* Remember the parameters the ROS has taken, a refused set is sent
+   again next time */
 
-  int32 temp32,data_length;;
+static void SiteTimPrmSent(struct ControlPRM *prm,int status) {
+  prmok=0;
+  if (status<0) return;
+  memcpy(&prmlast,prm,sizeof(struct ControlPRM));
+  prmok=1;
+}
+
+/* Ask the ROS for an ini entry. Returns the status of the reply, or 0
+   if the entry came back as a different type. */
+
+static int SiteTimQueryIni(char *name,char type,int32 *value) {
+  int32 data_length;
   char ini_entry_name[80];
-  char requested_entry_type,returned_entry_type;
+  char returned_entry_type=' ';
+  struct ROSMsg smsg,rmsg;
+  int found=0;
+
+  smsg.type=QUERY_INI_SETTINGS;
+  TCPIPMsgSend(sock, &smsg, sizeof(struct ROSMsg));
+  snprintf(ini_entry_name,sizeof(ini_entry_name),"%s",name);
+  data_length=strlen(ini_entry_name)+1;
+  TCPIPMsgSend(sock, &data_length, sizeof(int32));
+  TCPIPMsgSend(sock, &ini_entry_name, data_length*sizeof(char));
+  TCPIPMsgSend(sock, &type, sizeof(char));
+  TCPIPMsgRecv(sock, &returned_entry_type, sizeof(char));
+  TCPIPMsgRecv(sock, &data_length, sizeof(int32));
+  if((returned_entry_type==type)  ) {
+    TCPIPMsgRecv(sock, value, sizeof(int32));
+    found=1;
+  } 
+  TCPIPMsgRecv(sock, &rmsg, sizeof(struct ROSMsg));
+  if (debug) {
+    fprintf(stderr,"QUERY_INI_SETTINGS:type=%c\n",rmsg.type);
+    fprintf(stderr,"QUERY_INI_SETTINGS:status=%d\n",rmsg.status);
+    fprintf(stderr,"QUERY_INI_SETTINGS:entry_name=%s\n",ini_entry_name);
+    fprintf(stderr,"QUERY_INI_SETTINGS:entry_type=%c\n",returned_entry_type);
+    fprintf(stderr,"QUERY_INI_SETTINGS:entry_value=%d\n",*value);
+  }
+  if (found==0) return 0;
+  return rmsg.status;
+}
+
+/* Open the second connection and bind it to the first with the token
+   the ROS gave, returns zero once the samples will come on it */
+
+static int SiteTimDataOpen(int32 token) {
+  int fd;
+  int32 temp32[3];
+  struct ROSMsg smsg,rmsg;
+  struct SiteTimMsgBatch batch;
+
+  fd=SiteTimLinkOpen(&roslink,server,port);
+  if (fd==-1) return -1;
+  smsg.type=DATA_CHANNEL;
+  temp32[0]=rnum;
+  temp32[1]=cnum;
+  temp32[2]=token;
+  SiteTimMsgBatchZero(&batch);
+  SiteTimMsgBatchAdd(&batch,&smsg,sizeof(struct ROSMsg));
+  SiteTimMsgBatchAdd(&batch,temp32,sizeof(temp32));
+  if ((SiteTimMsgBatchSend(fd,&batch) <0) || 
+      (TCPIPMsgRecv(fd,&rmsg,sizeof(struct ROSMsg)) !=sizeof(struct ROSMsg)) ||
+      (rmsg.status !=1)) {
+    close(fd);
+    return -1;
+  }
+  if (debug) {
+    fprintf(stderr,"DATA_CHANNEL:type=%c\n",rmsg.type);
+    fprintf(stderr,"DATA_CHANNEL:status=%d\n",rmsg.status);
+  }
+  dsock=fd;
+  return 0;
+}
+
+int SiteTimSetupRadar() {
+
+  int32 temp32;
+  int status;
   struct ROSMsg smsg,rmsg;
   struct timeval currtime;
   time_t ttime;
   struct tm tstruct;
 
-  if ((sock=TCPIPMsgOpen(server,port)) == -1) {
+  SiteTimLinkRingClose(&roslink);
+  if ((dsock>0) && (dsock !=sock)) close(dsock);
+  if ((sock=SiteTimLinkOpen(&roslink,server,port)) == -1) {
     return -1;
   }
+  dsock=sock;
+  SiteTimSeqReset();
+  prmok=0;
   fprintf(stderr,"Rnum: %d Cnum: %d\n",rnum,cnum);
   smsg.type=SET_RADAR_CHAN;
   TCPIPMsgSend(sock, &smsg,sizeof(struct ROSMsg)); 
@@ -386,35 +729,65 @@ int SiteTimSetupRadar() {
     fprintf(stderr,"SET_RADAR_CHAN:type=%c\n",rmsg.type);
     fprintf(stderr,"SET_RADAR_CHAN:status=%d\n",rmsg.status);
   }
-  smsg.type=QUERY_INI_SETTINGS;
-  TCPIPMsgSend(sock, &smsg, sizeof(struct ROSMsg));
-  sprintf(ini_entry_name,"site_settings:ifmode");  
-  requested_entry_type='b';  
-  returned_entry_type=' ';  
+
+  /* The samples and bad TR times get a connection of their own if the
+     ROS hands out a token for one, so that they do not hold up the
+     control messages. If the ROS is then left waiting for a connection
+     that cannot be made start again without. */
+  if (datachan) {
+    temp32=0;
+    status=SiteTimQueryIni(SITEMSG_DATA_CHANNEL,'i',&temp32);
+    if ((status) && (temp32>0) && (SiteTimDataOpen(temp32) !=0)) {
+      fprintf(stderr,"ROS data channel unusable, reconnecting without\n");
+      close(sock);
+      datachan=0;
+      return SiteTimSetupRadar();
+    }
+  }
+  fprintf(stderr,"ROS data channel: %s\n",(dsock !=sock) ? "on" : "off");
   temp32=-1;
   ifmode=-1;
-  data_length=strlen(ini_entry_name)+1;
-  TCPIPMsgSend(sock, &data_length, sizeof(int32));
-  TCPIPMsgSend(sock, &ini_entry_name, data_length*sizeof(char));
-  TCPIPMsgSend(sock, &requested_entry_type, sizeof(char));
-  TCPIPMsgRecv(sock, &returned_entry_type, sizeof(char));
-  TCPIPMsgRecv(sock, &data_length, sizeof(int32));
-  if((returned_entry_type==requested_entry_type)  ) {
-    TCPIPMsgRecv(sock, &temp32, sizeof(int32));
-  } 
-  TCPIPMsgRecv(sock, &rmsg, sizeof(struct ROSMsg));
-  if (debug) {
-    fprintf(stderr,"QUERY_INI_SETTINGS:type=%c\n",rmsg.type);
-    fprintf(stderr,"QUERY_INI_SETTINGS:status=%d\n",rmsg.status);
-    fprintf(stderr,"QUERY_INI_SETTINGS:entry_name=%s\n",ini_entry_name);
-    fprintf(stderr,"QUERY_INI_SETTINGS:entry_type=%c\n",returned_entry_type);
-    fprintf(stderr,"QUERY_INI_SETTINGS:entry_value=%d\n",temp32);
-  }
-  if((rmsg.status) && (temp32>=0) ) ifmode=temp32;
+  status=SiteTimQueryIni("site_settings:ifmode",'b',&temp32);
+  if((status) && (temp32>=0) ) ifmode=temp32;
   if((ifmode!=0) && (ifmode!=1)) {
     fprintf(stderr,"QUERY_INI_SETTINGS: Bad IFMODE)\n");
     exit(0); 
   }
+
+  /* A ROS that knows this entry and answers 1 has switched on the beam
+     and frequency status at the end of each data reply for this
+     connection, which stands in for GET_PARAMETERS after every
+     sequence. An older ROS does not know it and nothing changes. */
+  temp32=0;
+  datastatus=0;
+  status=SiteTimQueryIni(SITEMSG_DATA_STATUS,'b',&temp32);
+  if ((status) && (temp32==1)) datastatus=1;
+  fprintf(stderr,"ROS data status: %s\n",(datastatus) ? "on" : "off");
+
+  /* Likewise WAIT_FOR_DATA, without it each sequence sleeps for the
+     time the samples should take */
+  temp32=0;
+  waitdata=0;
+  status=SiteTimQueryIni(SITEMSG_WAIT_FOR_DATA,'b',&temp32);
+  if ((status) && (temp32==1)) waitdata=1;
+  fprintf(stderr,"ROS wait for data: %s\n",(waitdata) ? "on" : "off");
+
+  /* The samples come through the shared memory ring if the ROS has one
+     ready. It has switched the ring on for this connection once it
+     answers, so if the ring then cannot be used start again without. */
+  if (roslink.type==SITELINK_SHM) {
+    temp32=0;
+    status=SiteTimQueryIni(SITELINK_SHM_SAMPLES,'b',&temp32);
+    if ((status) && (temp32==1) && 
+        (SiteTimLinkRingOpen(&roslink,rnum,cnum) !=0)) {
+      fprintf(stderr,"ROS sample ring unusable, reconnecting without\n");
+      close(sock);
+      roslink.type=SITELINK_UNIX;
+      return SiteTimSetupRadar();
+    }
+  }
+  fprintf(stderr,"ROS transport: %s sample ring: %s\n",
+          SiteTimLinkName(roslink.type),(roslink.ring !=NULL) ? "on" : "off");
   smsg.type=GET_PARAMETERS;
   TCPIPMsgSend(sock, &smsg, sizeof(struct ROSMsg));
   TCPIPMsgRecv(sock, &rprm, sizeof(struct ControlPRM));
@@ -423,11 +796,18 @@ int SiteTimSetupRadar() {
     fprintf(stderr,"GET_PARAMETERS:type=%c\n",rmsg.type);
     fprintf(stderr,"GET_PARAMETERS:status=%d\n",rmsg.status);
   }
+  /* the fields the library does not set stay as the ROS has them */
+  memcpy(&prmwant,&rprm,sizeof(struct ControlPRM));
 
   sprintf(sharedmemory,"IQBuff_ROS_%d_%d",rnum,cnum);
 
   iqbufsize = 2 * (mppul) * sizeof(int32) * 1e6 * (intsc+1) * nbaud / mpinc; /* calculate size of IQ buffer (JTK) */
 
+  /* the planar layout puts its descriptor ahead of the samples and pads
+     every plane out to the alignment */
+  if (iqlayout==SITEIQ_PLANAR) iqbufsize+=SITEIQ_ALIGN+
+                                 4*SITEIQ_ALIGN*(1e6*(intsc+1)/mpinc);
+
   fprintf(stderr,"intc: %d, nbaud %d, mpinc %d, iq buffer size is %d\n",intsc, nbaud, mpinc, iqbufsize);
   samples = (int16 *)ShMemAlloc(sharedmemory,iqbufsize,O_RDWR | O_CREAT,1,&shmemfd);
   
@@ -435,6 +815,14 @@ int SiteTimSetupRadar() {
     fprintf(stderr,"IQBuffer %s is Null\n",sharedmemory);
     SiteTimExit(-1);
   }
+  if (iqlayout==SITEIQ_PLANAR) {
+    iqhdr=(struct SiteIQHeader *) samples;
+    memset(iqhdr,0,SITEIQ_ALIGN);
+    iqhdr->magic=SITEIQ_MAGIC;
+    iqhdr->version=SITEIQ_VERSION;
+    iqhdr->layout=SITEIQ_INTERLEAVED;
+    iqhdr->hdrsze=SITEIQ_ALIGN;
+  }
 /* Setup the seqlog file here*/
   gettimeofday(&currtime,NULL);
   ttime=currtime.tv_sec;
@@ -484,6 +872,15 @@ int SiteTimSetupRadar() {
   } else {
     fprintf(stdout,"No seqlog directory defined\n");
   }
+  if (seqstat!=NULL) {
+      fclose(seqstat);
+      seqstat=NULL;
+  }
+  if ((seqlog_dir!=NULL) && (screen.on)) {
+    snprintf(seqstat_name,sizeof(seqstat_name),"%s/seqstat.%s%s.%04d%02d%02d",seqlog_dir,station,channame,tstruct.tm_year+1900,tstruct.tm_mon+1,tstruct.tm_mday);
+    fprintf(stdout,"seqstat filename: %s\n",seqstat_name);
+    seqstat=fopen(seqstat_name,"a+");
+  }
   fflush(stdout);
   return 0;
 }
@@ -558,20 +955,27 @@ int SiteTimStartIntt(int sec,int usec) {
     fprintf(stderr,"GET_PARAMETERS:status=%d\n",rmsg.status);
   }
 
-  rprm.tbeam=bmnum;   
-  rprm.tfreq=12000;   
-  rprm.trise=5000;   
-  rprm.baseband_samplerate=((double)nbaud/(double)txpl)*1E6; 
-  rprm.filter_bandwidth=rprm.baseband_samplerate; 
-  rprm.match_filter=dmatch;
-  rprm.number_of_samples=total_samples+nbaud+10; 
-  rprm.priority=cnum;
-  rprm.buffer_index=0;
+  prmwant.tbeam=bmnum;   
+  prmwant.tfreq=12000;   
+  if (plan.valid) {
+    /* the same sequence fields the integration will send */
+    SiteTimPlanPrm(&plan,&prmwant);
+  } else {
+    prmwant.trise=5000;   
+    prmwant.baseband_samplerate=((double)nbaud/(double)txpl)*1E6; 
+    prmwant.filter_bandwidth=prmwant.baseband_samplerate; 
+    prmwant.match_filter=dmatch;
+    if (rossmp>0) prmwant.number_of_samples=rossmp;
+    else prmwant.number_of_samples=total_samples+nbaud+10; 
+    prmwant.priority=cnum;
+    prmwant.buffer_index=0;
+  }
 
   smsg.type=SET_PARAMETERS;
   TCPIPMsgSend(sock,&smsg,sizeof(struct ROSMsg));
-  TCPIPMsgSend(sock,&rprm,sizeof(struct ControlPRM));
+  TCPIPMsgSend(sock,&prmwant,sizeof(struct ControlPRM));
   TCPIPMsgRecv(sock,&rmsg,sizeof(struct ROSMsg));
+  SiteTimPrmSent(&prmwant,rmsg.status);
   if (debug) {
     fprintf(stderr,"SET_PARAMETERS:type=%c\n",rmsg.type);
     fprintf(stderr,"SET_PARAMETERS:status=%d\n",rmsg.status);
@@ -609,13 +1013,20 @@ int SiteTimFCLR(int stfreq,int edfreq) {
   rprm.tbeam=bmnum;   
   rprm.tfreq=tfreq;   
   rprm.rfreq=tfreq;   
-  rprm.trise=5000;   
-  rprm.baseband_samplerate=((double)nbaud/(double)txpl)*1E6; 
-  rprm.filter_bandwidth=rprm.baseband_samplerate; 
-  rprm.match_filter=dmatch;
-  rprm.number_of_samples=total_samples+nbaud+10; 
-  rprm.priority=cnum;
-  rprm.buffer_index=0;
+  if (plan.valid) {
+    /* same sequence fields as the integration, including the index
+       the sequence was registered under */
+    SiteTimPlanPrm(&plan,&rprm);
+  } else {
+    rprm.trise=5000;   
+    rprm.baseband_samplerate=((double)nbaud/(double)txpl)*1E6; 
+    rprm.filter_bandwidth=rprm.baseband_samplerate; 
+    rprm.match_filter=dmatch;
+    rprm.number_of_samples=total_samples+nbaud+10; 
+    rprm.priority=cnum;
+    rprm.current_pulseseq_index=0;
+    rprm.buffer_index=0;
+  }
 
   smsg.type=SET_PARAMETERS;
   TCPIPMsgSend(sock,&smsg,sizeof(struct ROSMsg));
@@ -649,22 +1060,112 @@ int SiteTimFCLR(int stfreq,int edfreq) {
     fprintf(stderr,"REQUEST_ASSIGNED_FREQ:type=%c\n",rmsg.status);
     fprintf(stderr,"REQUEST_ASSIGNED_FREQ:status=%d\n",rmsg.status);
   }
+  /* the search can leave the ROS on other settings */
+  prmok=0;
 
   return tfreq;
 }
 
 
 
-int SiteTimTimeSeq(int *ptab) {
+/* Screening statistics go to their own seqstat file next to the seqlog,
+   so the seqlog record layout is unchanged.  Each seqstat record is:
+   int32 event_secs, int32 event_usecs, int32 peak, int32 clip,
+   float noise, int32 drop, int32 ndrop.  The first two match the seqlog
+   record for the same sequence. */
+
+static void SiteTimScreenLog(struct SiteTimSlot *rx,
+                             struct SiteTimScreenStat *stat,int ndrop) {
+  int32 temp32;
+  if ((seqstat==NULL) || (screen.on==0)) return;
+  fwrite(&rx->dprm.event_secs,sizeof(int32),1,seqstat);
+  temp32=floor(rx->dprm.event_nsecs/1000); 
+  fwrite(&temp32,sizeof(int32),1,seqstat);
+  fwrite(&stat->peak,sizeof(int32),1,seqstat);
+  fwrite(&stat->clip,sizeof(int32),1,seqstat);
+  fwrite(&stat->noise,sizeof(float),1,seqstat);
+  fwrite(&stat->drop,sizeof(int32),1,seqstat);
+  temp32=ndrop;
+  fwrite(&temp32,sizeof(int32),1,seqstat);
+}
+
+/* Clear the whole of the global power and ACF arrays */
+
+static void SiteTimZeroACF() {
+  int i,j;
+  for (i=0;i<MAX_RANGE;i++) {
+      pwr0[i]=0;
+      for (j=0;j<LAG_SIZE*2;j++) {
+        acfd[i*LAG_SIZE*2+j]=0;
+        xcfd[i*LAG_SIZE*2+j]=0;
+      }
+  }
+}
+
+/* Send a sequence from the cache to the ROS under its index */
+
+static int SiteTimRegisterSeq(struct SiteTimSeq *seq) {
 
-  int i;
-  int flag,index=0;
   struct ROSMsg smsg,rmsg;
   int32_t parr[1]={1};
   struct SeqPRM tprm;
+  struct SiteTimMsgBatch batch;
+
+  tprm.index=seq->index;
+  tprm.len=seq->buf->len;
+  tprm.step=CLOCK_PERIOD;
+  tprm.samples=seq->prm.samples;
+  tprm.smdelay=seq->prm.smdelay;
+  tprm.nrang=seq->prm.nrang;
+  tprm.frang=seq->prm.frang;
+  tprm.rsep=seq->prm.rsep;
+  tprm.smsep=seq->prm.smsep;
+  tprm.lagfr=seq->prm.lagfr;
+  tprm.txpl=seq->prm.txpl;
+  tprm.mppul=seq->prm.mppul;
+  tprm.mpinc=seq->prm.mpinc;
+  tprm.mlag=seq->prm.mlag;
+  tprm.nbaud=seq->prm.nbaud;
+  tprm.stdelay=seq->prm.stdelay;
+  tprm.gort=seq->prm.gort;
+  tprm.rtoxmin=seq->prm.rtoxmin;
+  
+  smsg.type=REGISTER_SEQ;
+  SiteTimMsgBatchZero(&batch);
+  SiteTimMsgBatchAdd(&batch, &smsg, sizeof(struct ROSMsg));
+  SiteTimMsgBatchAdd(&batch, &tprm, sizeof(struct SeqPRM));
+  SiteTimMsgBatchAdd(&batch, seq->buf->rep, sizeof(unsigned char)*tprm.len);
+  SiteTimMsgBatchAdd(&batch, seq->buf->code, sizeof(unsigned char)*tprm.len);
+  SiteTimMsgBatchAdd(&batch, seq->prm.pat, sizeof(int32_t)*tprm.mppul);
+  if ((tprm.nbaud > 1) && (seq->prm.code !=NULL)) {
+    SiteTimMsgBatchAdd(&batch, seq->prm.code, sizeof(int32_t)*tprm.nbaud);
+  } else {
+    SiteTimMsgBatchAdd(&batch, parr, sizeof(int32_t)*tprm.nbaud);
+  }
+  if (SiteTimMsgBatchSend(sock, &batch) <0) return -1;
+  TCPIPMsgRecv(sock, &rmsg, sizeof(struct ROSMsg));
+  if (debug) {
+    fprintf(stderr,"REGISTER_SEQ:type=%c\n",rmsg.type);
+    fprintf(stderr,"REGISTER_SEQ:status=%d\n",rmsg.status);
+    fprintf(stderr,"REGISTER_SEQ:index=%d hash=%08x\n",seq->index,seq->hash);
+  }
+  prmok=0;
+  if (rmsg.status !=1) return -1;
+  seq->reg=1;
+  return 0;
+}
+
+int SiteTimTimeSeq(int *ptab) {
+
+  int i;
+  int index=0;
+  int *pat,*code;
+  struct SiteTimSeq *seq;
+
   SiteTimExit(0);
-  if (tsgbuf !=NULL) TSGFree(tsgbuf);
-  if (tsgprm.pat !=NULL) free(tsgprm.pat);
+  pat=tsgprm.pat;
+  if (SiteTimGrow((void **) &pat,&patmax,mppul,sizeof(int32_t)) !=0)
+    return -1;
   memset(&tsgprm,0,sizeof(struct TSGprm));
 
   tsgprm.nrang=nrang;         
@@ -680,49 +1181,58 @@ int SiteTimTimeSeq(int *ptab) {
   tsgprm.mlag=0;
   tsgprm.nbaud=nbaud;
   tsgprm.code=pcode;
-  tsgprm.pat=malloc(sizeof(int32_t)*tsgprm.mppul);
+  tsgprm.pat=pat;
   for (i=0;i<tsgprm.mppul;i++) tsgprm.pat[i]=ptab[i];
 
-  tsgbuf=TSGMake(&tsgprm,&flag);
+  /* a sequence already made and held by the ROS is only selected */
+  seq=SiteTimSeqFind(&tsgprm);
+  if (seq==NULL) seq=SiteTimSeqMake(&tsgprm);
+  if (seq==NULL) return -1;
 
-  if (tsgbuf==NULL) return -1;
-  tprm.index=index;
-  tprm.len=tsgbuf->len;
-  tprm.step=CLOCK_PERIOD;
-  tprm.samples=tsgprm.samples;
-  tprm.smdelay=tsgprm.smdelay;
-  tprm.nrang=tsgprm.nrang;
-  tprm.frang=tsgprm.frang;
-  tprm.rsep=tsgprm.rsep;
-  tprm.smsep=tsgprm.smsep;
-  tprm.lagfr=tsgprm.lagfr;
-  tprm.txpl=tsgprm.txpl;
-  tprm.mppul=tsgprm.mppul;
-  tprm.mpinc=tsgprm.mpinc;
-  tprm.mlag=tsgprm.mlag;
-  tprm.nbaud=tsgprm.nbaud;
-  tprm.stdelay=tsgprm.stdelay;
-  tprm.gort=tsgprm.gort;
-  tprm.rtoxmin=tsgprm.rtoxmin;
-  
-  smsg.type=REGISTER_SEQ;
-  TCPIPMsgSend(sock, &smsg, sizeof(struct ROSMsg));
-  TCPIPMsgSend(sock, &tprm, sizeof(struct SeqPRM));
-  TCPIPMsgSend(sock, tsgbuf->rep, sizeof(unsigned char)*tprm.len);
-  TCPIPMsgSend(sock, tsgbuf->code, sizeof(unsigned char)*tprm.len);
-  TCPIPMsgSend(sock, tsgprm.pat, sizeof(int32_t)*tprm.mppul);
-  if (nbaud > 1) {
-    TCPIPMsgSend(sock, tsgprm.code, sizeof(int32_t)*tprm.nbaud);
-  } else {
-    TCPIPMsgSend(sock, parr, sizeof(int32_t)*tprm.nbaud);
+  if ((seq->reg==0) && (SiteTimRegisterSeq(seq) !=0)) {
+    if (seq->index==0) {
+      SiteTimSeqDrop(seq);
+      return -1;
+    }
+    /* the ROS only takes index 0, so hold one sequence from now on */
+    fprintf(stderr,"REGISTER_SEQ: index %d refused, using index 0 only\n",
+            seq->index);
+    SiteTimSeqDrop(seq);
+    SiteTimSeqConfig(1,seqdir);
+    seq=SiteTimSeqMake(&tsgprm);
+    if (seq==NULL) return -1;
+    if (SiteTimRegisterSeq(seq) !=0) {
+      SiteTimSeqDrop(seq);
+      return -1;
+    }
   }
-  TCPIPMsgRecv(sock, &rmsg, sizeof(struct ROSMsg));
+
+  tsgbuf=seq->buf;
+  pat=tsgprm.pat;
+  code=tsgprm.code;
+  tsgprm=seq->prm;
+  tsgprm.pat=pat;
+  tsgprm.code=code;
+  index=seq->index;
+  rossmp=0;
+
+  /* the lag part of the plan is filled in by the first integration */
+  if (SiteTimPlanSeq(&plan,&tsgprm,index,nbaud,tsgprm.txpl,dmatch,cnum) !=0) 
+    return -1;
+
+  /* pick the phase code decoder once for this sequence */
+  SiteTimDecodeSelect(&decoder,pcode,nbaud);
   if (debug) {
-    fprintf(stderr,"REGISTER_SEQ:type=%c\n",rmsg.type);
-    fprintf(stderr,"REGISTER_SEQ:status=%d\n",rmsg.status);
+    fprintf(stderr,"REGISTER_SEQ:decoder=%s fixed=%d\n",
+            SiteTimDecodeName(decoder.type),decoder.fixed);
   }
 
-  if (rmsg.status !=1) return -1;
+  /* lay the accumulators out for this sequence */
+  if (SiteTimLagAccMake(&lagacc,tsgprm.nrang,mplgs) !=0) {
+    fprintf(stderr,"Lag accumulators are Null\n");
+    SiteTimExit(-1);
+  }
+  SiteTimZeroACF();
 
   lagfr=tsgprm.lagfr;
   smsep=tsgprm.smsep;
@@ -731,16 +1241,479 @@ int SiteTimTimeSeq(int *ptab) {
   return index;
 }
 
+/* Log, screen, decode and sum one sequence from the ring. Runs on the
+   ring's worker when the acquisition is pipelined, otherwise straight
+   after the data arrive. */
+
+static void SiteTimSeqProcess(struct SiteTimSlot *rx) {
+
+  struct SiteTimSeqState *st=&seqstate;
+  int nave=st->nave;
+  int ndrop=st->ndrop;
+  int iqoff=st->iqoff;
+  int iqsze=st->iqsze;
+  int xgated=st->xgated;
+  int planar=st->planar,plane=st->plane,step=st->step;
+  int acfsmp=st->acfsmp;
+  int farsmp=st->farsmp,farnum=st->farnum;
+  int badrng=st->badrng;
+  int atstp=st->atstp;
+  int pooled=st->pooled;
+  int *lagtable[2];
+  int roff=REAL_BUF_OFFSET;
+  int ioff=IMAG_BUF_OFFSET;
+  int rngoff=2;
+  int xcfoff=0;
+  int i,n,nsamp,nuse=0,slot=0,max,*code;
+  void *dest=NULL;
+  int16 *mi=NULL,*mq=NULL,*bi=NULL,*bq=NULL;
+  struct SiteTimScreenStat sstat;
+  struct SiteTimDecodeStat dstat,*dptr=NULL;
+  short I,Q;
+  double phi_m,phi_i,phi_d;
+  int32 temp32;
+  struct tm tstruct;
+  time_t ttime;
+  char filename[256];
+
+  lagtable[0]=st->lagtable[0];
+  lagtable[1]=st->lagtable[1];
+
+  seqtval[nave].tv_sec=rx->tick.tv_sec;
+  seqtval[nave].tv_nsec=rx->tick.tv_usec*1000;
+  seqatten[nave]=0.;
+  seqnoise[nave]=0;
+  seqbadtr[nave].num=0;
+  memset(&sstat,0,sizeof(sstat));
+  memset(&dstat,0,sizeof(dstat));
+  dstat.level=screen.level;
+  if (screen.on) dptr=&dstat;
+
+  ttime=rx->dprm.event_secs;
+  if ( ttime < 100 ) {
+    ttime=rx->tick.tv_sec;
+  }
+  gmtime_r(&ttime,&tstruct);
+  if(seqlog_dir!=NULL) { 
+    sprintf(filename,"%s/seqlog.%s%s.%04d%02d%02d",seqlog_dir,station,channame,tstruct.tm_year+1900,tstruct.tm_mon+1,tstruct.tm_mday);
+    if(strcmp(filename,seqlog_name)!=0) {
+      strcpy(seqlog_name,filename);
+      if (seqlog!=NULL) {
+        fflush(seqlog);
+        fclose(seqlog);
+        seqlog=NULL;
+      }
+      fprintf(stdout,"seqlog filename: %s\n",seqlog_name);
+      seqlog=fopen(seqlog_name,"a+");
+      if (screen.on) {
+        if (seqstat!=NULL) fclose(seqstat);
+        snprintf(seqstat_name,sizeof(seqstat_name),"%s/seqstat.%s%s.%04d%02d%02d",seqlog_dir,station,channame,tstruct.tm_year+1900,tstruct.tm_mon+1,tstruct.tm_mday);
+        fprintf(stdout,"seqstat filename: %s\n",seqstat_name);
+        seqstat=fopen(seqstat_name,"a+");
+      }
+      fflush(stdout);
+    }
+  }
+  if (seqlog!=NULL) {
+    fwrite(&rx->dprm.event_secs,sizeof(int32),1,seqlog);
+    temp32=floor(rx->dprm.event_nsecs/1000); 
+    fwrite(&temp32,sizeof(int32),1,seqlog);
+    fwrite(&rx->tbeam,sizeof(int32),1,seqlog);
+    fwrite(&rx->tfreq,sizeof(int32),1,seqlog);
+    fwrite(&rx->badtr.length,sizeof(int32),1,seqlog);
+    for(i=0;i<rx->badtr.length;i++) {
+      temp32=rx->badtr.start_usec[i]; 
+      fwrite(&temp32,sizeof(int32),1,seqlog);
+      temp32=rx->badtr.duration_usec[i]; 
+      fwrite(&temp32,sizeof(int32),1,seqlog);
+    }
+  }
+  if(f_diagnostic_ascii!=NULL) {
+      fprintf(f_diagnostic_ascii,"** TX: ");
+      for(i=0;i<rx->ntx;i++)
+        fprintf(f_diagnostic_ascii,"%3d ",i);
+      fprintf(f_diagnostic_ascii,"\n");
+      fprintf(f_diagnostic_ascii,"  AGC: ");
+      for(i=0;i<rx->ntx;i++)
+        fprintf(f_diagnostic_ascii,"%3d ",( 1 ^ rx->tx.AGC[i]));
+      fprintf(f_diagnostic_ascii,"\n");
+      fprintf(f_diagnostic_ascii,"  LOW: ");
+      for(i=0;i<rx->ntx;i++)
+        fprintf(f_diagnostic_ascii,"%3d ",rx->tx.LOWPWR[i]);
+      fprintf(f_diagnostic_ascii,"\n");
+  }
+
+
+  if (rx->newbeam) {
+    /* the ROS has moved on, the sequence is only logged */
+    SiteTimScreenLog(rx,&sstat,ndrop);
+    return;
+  }
+
+/* JDS : For testing only */
+/*
+  rx->dprm.status=0;
+  rx->dprm.samples=0;
+  if (rx->main!=NULL) free(rx->main);
+  if (rx->back!=NULL) free(rx->back);
+  rx->main=NULL;
+  rx->back=NULL;
+  rx->main=malloc(sizeof(uint32)*rx->dprm.samples);
+  rx->back=malloc(sizeof(uint32)*rx->dprm.samples);
+  rx->badtr.length=0;
+*/
+/* JDS: End testing block */
+  code=pcode;
+  if(f_diagnostic_ascii!=NULL) {
+    fprintf(f_diagnostic_ascii,"Sequence: Parameters: START\n");
+    fprintf(f_diagnostic_ascii,"  bmnum=%8d nbaud=%8d txpl=%8d tfreq=%8d code=", bmnum, nbaud, txpl,tfreq);
+    for(i=0;i<nbaud;i++){
+      if (code!=NULL)
+        fprintf(f_diagnostic_ascii,"%8d,", code[i]);
+      else
+        fprintf(f_diagnostic_ascii,"%8d,", 1);
+    }
+    fprintf(f_diagnostic_ascii,"\n");
+    fprintf(f_diagnostic_ascii,"Sequence: Parameters: END\n");
+    fprintf(f_diagnostic_ascii,"Sequence: Invert %d\n",invert);
+  }
+
+  if(rx->dprm.status==0) {
+    nsamp=(int)rx->dprm.samples;
+    nuse=nsamp;
+    if ((mplgexs==0) && (nuse>acfsmp)) nuse=acfsmp;
+/*
+    fp=f_diagnostic_ascii;
+    f_diagnostic_ascii=stderr;
+*/
+    if(f_diagnostic_ascii!=NULL) {
+      fprintf(f_diagnostic_ascii,"Sequence : Raw Data : START\n");
+      fprintf(f_diagnostic_ascii,"  nsamp: %8d\n",nsamp);
+      fprintf(f_diagnostic_ascii,"index I_m Q_m I_m^2+Q_m^2 phi_m I_i Q_i I_i^2+Q_i^2 phi_i phi_d\n");
+      for(n=0;n<nsamp;n++){
+        Q=(short)((rx->main[n] & 0xffff0000) >> 16);
+        I=(short)(rx->main[n] & 0x0000ffff);
+        if(invert!=0) {
+          Q=-Q;
+          I=-I;
+        }
+        phi_m=atan2(Q,I);
+        if(f_diagnostic_ascii!=NULL) {
+          fprintf(f_diagnostic_ascii,"%8d %8d %8d %8d %8.3lf ", n, I, Q, (int)(I*I+Q*Q), phi_m);
+         }
+        Q=(short)((rx->back[n] & 0xffff0000) >> 16);
+        I=(short)(rx->back[n] & 0x0000ffff);
+        phi_i=atan2(Q,I);
+        phi_d=phi_i-phi_m;
+        if(phi_d >=  M_PI ) phi_d=phi_d-(2.*M_PI);
+        if(phi_d < -M_PI ) phi_d=phi_d+(2.*M_PI);
+        if(f_diagnostic_ascii!=NULL) {
+          fprintf(f_diagnostic_ascii,"%8d %8d %8d %8.3lf %8.3lf\n", I, Q, (int)(I*I+Q*Q),phi_i,phi_d);
+        }
+      }
+      fprintf(f_diagnostic_ascii,"Sequence: Raw Data: END\n");
+    }
+/*
+    f_diagnostic_ascii=fp;
+*/
+/*
+    if(rx->dprm.samples<total_samples) {
+      fprintf(stderr,"Not enough  samples from the ROS in SiteIntegrate\n");
+      fflush(stderr);
+    }
+*/
+    slot=(planar) ? 4*plane*sizeof(int16) : nuse*2*sizeof(uint32);
+    seqoff[nave]=iqsze/2;/*Sequence offset in 16bit units */
+    seqsze[nave]=slot/2; /* Sequence length in 16bit units */
+
+    /* the per sequence copies are kept and only grow */
+    max=seqbadmax[nave];
+    if ((SiteTimGrow((void **) &seqbadtr[nave].start,&max,
+                     rx->badtr.length,sizeof(uint32)) !=0) ||
+        (SiteTimGrow((void **) &seqbadtr[nave].length,&seqbadmax[nave],
+                     rx->badtr.length,sizeof(uint32)) !=0)) {
+      fprintf(stderr,"%s seq %d :: cannot allocate bad TR times\n",
+              station,nave);
+      rx->badtr.length=0;
+    }
+    seqbadtr[nave].num=rx->badtr.length;
+
+    memcpy(seqbadtr[nave].start,rx->badtr.start_usec,
+         sizeof(uint32)*rx->badtr.length);
+    memcpy(seqbadtr[nave].length,rx->badtr.duration_usec,
+         sizeof(uint32)*rx->badtr.length);
+
+  /* invert, decode phase coding and copy samples here */
+
+/* samples is natively an int16 pointer */
+/* rx->main is natively an uint32 pointer */
+/* rx->back is natively an uint32 pointer */
+/* main samples go at iqoff bytes into the samples area, back samples follow */
+/* the phase inversion and decoding are done on the way across in one pass */
+/* only the nuse samples the ACF reads are kept */
+/* in the planar layout the slot holds the main I, main Q, back I and back Q planes */
+/* when the reply was received at iqoff the decode runs in place, the back samples moving down to follow the kept main ones */
+/* the screening peak and clip are gathered by the decode as it reads the samples */
+/* the main samples are screened while still in cache, the back ones are only decoded if that passes */
+
+    dest = (void *)(samples);  /* look iqoff bytes into samples area */
+    dest+=iqoff;
+    mi=(int16 *) dest;
+    if (planar) {
+      mq=mi+plane;
+      bi=mq+plane;
+      bq=bi+plane;
+    } else {
+      mq=mi+1;
+      bi=mi+2*nuse;
+      bq=bi+1;
+    }
+    if ((iqoff+slot)<iqbufsize) {
+      SiteTimDecodeCopy(&decoder,mi,(planar) ? mq : NULL,
+                        (int16 *) rx->main,nsamp,nuse,invert!=0,dptr);
+      if (screen.on) {
+        sstat.peak=dstat.peak;
+        sstat.clip=dstat.clip;
+        if ((farsmp+farnum)<=nuse) {
+          sstat.noise=SiteTimScreenMedian(mi+step*farsmp,mq+step*farsmp,
+                                          step,farnum);
+          seqnoise[nave]=sstat.noise;
+        }
+        sstat.drop=SiteTimScreenTest(&screen,&sstat);
+      }
+      if (sstat.drop==SCREEN_KEEP) {
+        SiteTimDecodeCopy(&decoder,bi,(planar) ? bq : NULL,
+                          (int16 *) rx->back,nsamp,nuse,0,dptr);
+        if (screen.on) {
+          sstat.peak=dstat.peak;
+          sstat.clip=dstat.clip;
+          sstat.drop=SiteTimScreenTest(&screen,&sstat);
+        }
+      }
+      if((nbaud>1) && (f_diagnostic_ascii!=NULL) && 
+         (sstat.drop==SCREEN_KEEP)) {
+        fprintf(f_diagnostic_ascii,"PCODE: DECODE_START\n");
+        fprintf(f_diagnostic_ascii,"nsamp: %8d\n",nsamp);
+        for(n=0;(n<(nsamp-nbaud)) && (n<nuse);n++){
+          I=mi[step*n];
+          Q=mq[step*n];
+          fprintf(f_diagnostic_ascii,"%8d %8d %8d %8d ", n, I, Q, (int)sqrt(I*I+Q*Q));
+          I=bi[step*n];
+          Q=bq[step*n];
+          fprintf(f_diagnostic_ascii,"%8d %8d %8d\n", I, Q, (int)sqrt(I*I+Q*Q));
+        }
+        fprintf(f_diagnostic_ascii,"PCODE: DECODE_END\n");
+      }
+    } else {
+      fprintf(stderr,"IQ Buffer overrun in SiteIntegrate\n");
+      fflush(stderr);
+    }
+    if (sstat.drop !=SCREEN_KEEP) {
+      /* leave the slot to be overwritten by the next sequence */
+      ndrop++;
+      if (debug)
+        fprintf(stderr,"%s seq %d :: dropped %d peak %d clip %d noise %g\n",
+                station,nave,sstat.drop,sstat.peak,sstat.clip,sstat.noise);
+    } else {
+      iqsze+=slot;  /*  Total of number bytes so far copied into samples array */
+      if (debug) {
+        fprintf(stderr,"%s seq %d :: ioff: %8d\n",station,nave,iqoff);
+        fprintf(stderr,"%s seq %d :: samples 16bit :\n",station,nave);
+        fprintf(stderr," [  n  ] :: [  Im  ] [  Qm  ] :: [ Ii ] [ Qi ]\n");
+        for(n=0;n<(nuse);n++){
+          fprintf(stderr," %7d :: %7d %7d ",n,(int) mi[step*n],(int) mq[step*n]);
+          fprintf(stderr,":: %7d %7d\n",(int) bi[step*n],(int) bq[step*n]);
+        }
+        fprintf(stderr,"%s seq %d :: iqsze: %8d\n",station,nave,iqsze);
+      }
+
+    /* calculate ACF */   
+      if (mplgexs==0) {
+        dest = (void *)(samples);
+        dest += iqoff;
+        rngoff=2*rxchn; 
+        xcfoff=2*nuse;
+        if (planar) {
+          rngoff=1;
+          roff=0;
+          ioff=plane;
+          xcfoff=2*plane;
+        }
+        if (debug) 
+        fprintf(stderr,"%s seq %d :: rngoff %d rxchn %d\n",station,nave,rngoff,rxchn);
+        if (debug) 
+        fprintf(stderr,"%s seq %d :: SiteTimLagProducts xcf %d\n",station,nave,xcf);
+        /* lag-0 power, ACF and XCF in one pass over the samples */
+        if (pooled)
+          SiteTimPoolLagProducts(&tsgprm,(int16 *) dest,rngoff,skpnum!=0,
+                                 roff,ioff,lagtable,xcfoff,badrng,
+                                 seqatten[nave]*atstp,xcf==1,
+                                 (xgated) ? xgate : NULL);
+        else SiteTimLagAccAdd(&lagacc,0,&tsgprm,(int16 *) dest,rngoff,
+                              skpnum!=0,roff,ioff,lagtable,xcfoff,badrng,
+                              seqatten[nave]*atstp,xcf==1,
+                              (xgated) ? xgate : NULL);
+        /* once the first few sequences are in, keep the XCF only for
+           the gates with signal in them */
+        if ((xcf==1) && (xcfgate>0) && (xgated==0) &&
+            (nave+1==xcfgateseq)) {
+          memset(xgatepwr,0,sizeof(float)*tsgprm.nrang);
+          SiteTimLagAccPower(&lagacc,0,xgatepwr);
+          if (pooled) SiteTimPoolPower(xgatepwr);
+          n=SiteTimLagGateMask(xgatepwr,tsgprm.nrang,xcfgate,xgate);
+          xgated=1;
+          if (debug)
+            fprintf(stderr,"%s seq %d :: XCF kept for %d of %d gates\n",
+                    station,nave,n,tsgprm.nrang);
+        }
+        if ((nave>0) && (seqatten[nave] !=seqatten[nave])) {
+        if (debug) 
+        fprintf(stderr,"%s seq %d :: rngoff %d rxchn %d\n",station,nave,rngoff,rxchn);
+        if (debug) 
+          fprintf(stderr,"%s seq %d :: ACFNormalize\n",station,nave);
+              if (pooled) SiteTimPoolEnd(&lagacc,xcf==1);
+              SiteTimLagAccFloat(&lagacc);
+              ACFNormalize(lagacc.pwr0,lagacc.acfd,lagacc.xcfd,
+                           tsgprm.nrang,mplgs,atstp); 
+        }  
+        if (debug) 
+        fprintf(stderr,"%s seq %d :: rngoff %d rxchn %d\n",station,nave,rngoff,rxchn);
+
+
+      } else if (st->streamed) {
+        /* fold the main samples into the extended lag sums now */
+        dest = (void *)(samples);
+        dest += iqoff;
+        if (debug) 
+          fprintf(stderr,"%s seq %d :: SiteTimACFexAdd\n",station,nave);
+        SiteTimACFexAdd(&acfex,&tsgprm,(int16 *) dest,nuse,2*rxchn,
+                        skpnum!=0,roff,ioff,mplgexs,lagtable);
+      }
+      nave++;
+      if (iqhdr !=NULL) iqhdr->seqnum=nave;
+      iqoff=iqsze;  /* set the offset bytes for the next sequence */
+    }
+
+  } else {
+  }
+  SiteTimScreenLog(rx,&sstat,ndrop);
+  if(f_diagnostic_ascii!=NULL) fprintf(f_diagnostic_ascii,"Sequence: END\n");
+
+  st->nave=nave;
+  st->ndrop=ndrop;
+  st->iqoff=iqoff;
+  st->iqsze=iqsze;
+  st->xgated=xgated;
+}
+
+/* Once a sequence is done with, its slot in the ROS ring can be
+   filled again */
+
+static void SiteTimSlotProcess(struct SiteTimSlot *rx) {
+  SiteTimSeqProcess(rx);
+  if (rx->inring) SiteTimLinkRelease(&roslink,rx->ringseq);
+}
+
+/* The bulk part of a data reply, the samples unless they are in the
+   ROS ring and the bad TR times. These come on the data channel when
+   there is one. */
+
+static void SiteTimDataRecv(struct SiteTimSlot *rx,int zcopy) {
+  if (rx->inring==0) {
+    if (debug) {
+      fprintf(stderr,"%s GET_DATA: rdata.main: uint32: %ld array: %ld\n",station,sizeof(uint32),sizeof(uint32)*rx->dprm.samples);
+    }
+    if ((zcopy) && ((seqstate.iqoff+2*sizeof(uint32)*rx->dprm.samples)<
+                    iqbufsize)) {
+      /* straight into the next sequence's place in the IQ segment,
+         main then back, where the decode leaves them */
+      rx->main=(uint32 *) ((char *) samples+seqstate.iqoff);
+      rx->back=rx->main+rx->dprm.samples;
+    } else {
+      if (SiteTimRingSlotSize(rx,rx->dprm.samples,0) !=0) {
+        fprintf(stderr,"%s GET_DATA: cannot allocate samples\n",station);
+        SiteTimExit(-1);
+      }
+      rx->main=rx->mbuf;
+      rx->back=rx->bbuf;
+    }
+    if (debug) {
+      fprintf(stderr,"%s GET_DATA: recv main\n",station);
+    }
+    TCPIPMsgRecv(dsock, rx->main, sizeof(uint32)*rx->dprm.samples);
+    if (debug) {
+      fprintf(stderr,"%s GET_DATA: recv back\n",station);
+    }
+    TCPIPMsgRecv(dsock, rx->back, sizeof(uint32)*rx->dprm.samples);
+  }
+
+  TCPIPMsgRecv(dsock, &rx->badtr.length, sizeof(rx->badtr.length));
+  if (debug) {
+    fprintf(stderr,"%s GET_DATA: trtimes length %d\n",station,rx->badtr.length);
+  }
+  if (SiteTimRingSlotSize(rx,0,rx->badtr.length) !=0) {
+    fprintf(stderr,"%s GET_DATA: cannot allocate bad TR times\n",station);
+    SiteTimExit(-1);
+  }
+  if (debug) {
+    fprintf(stderr,"%s GET_DATA: start_usec\n",station);
+  }
+  TCPIPMsgRecv(dsock, rx->badtr.start_usec,
+             sizeof(uint32)*rx->badtr.length);
+  if (debug) {
+    fprintf(stderr,"%s GET_DATA: duration_usec\n",station);
+  }
+  TCPIPMsgRecv(dsock, rx->badtr.duration_usec,
+             sizeof(uint32)*rx->badtr.length);
+}
+
+/* A ROS that writes the bulk part out in full before it goes on can be
+   held up by it until it is read, and then cannot send the rest of the
+   data reply or answer the next request. So while a bulk part is due
+   wait on both connections before reading the control one; returns 1
+   if only the data channel has anything, in which case the bulk part
+   has to be read first. */
+
+static int SiteTimDataFirst() {
+  struct pollfd pfd[2];
+  int n;
+
+  if (dsock==sock) return 0;
+  pfd[0].fd=sock;
+  pfd[0].events=POLLIN;
+  pfd[1].fd=dsock;
+  pfd[1].events=POLLIN;
+  do n=poll(pfd,2,-1); while ((n<0) && (errno==EINTR));
+  if (n<=0) return 0;
+  return (pfd[0].revents==0) && (pfd[1].revents !=0);
+}
+
+/* Read the bulk part of rx ahead of a control reply if the ROS is
+   waiting on it, returns 1 if it was read */
+
+static int SiteTimDataAhead(struct SiteTimSlot *rx,int zcopy) {
+  if (SiteTimDataFirst()==0) return 0;
+  SiteTimDataRecv(rx,zcopy);
+  return 1;
+}
+
+/* Likewise for the last sequence, whose slot then goes to the worker */
+
+static void SiteTimDataWait(struct SiteTimSlot **pend,int zcopy) {
+  if ((*pend==NULL) || (SiteTimDataAhead(*pend,zcopy)==0)) return;
+  SiteTimRingPush(&ring);
+  *pend=NULL;
+}
+
 int SiteTimIntegrate(int (*lags)[2], int32_t rfreq) {
 
   int *lagtable[2]={NULL,NULL};
-  int lagsum[LAG_SIZE];
+  int *lagsum=NULL;
 
   int badrng=0;
-  int i,j;
+  int i;
   int roff=REAL_BUF_OFFSET;
   int ioff=IMAG_BUF_OFFSET;
-  int rngoff=2;
 
   struct timeval tick;
   struct timeval tack;
@@ -748,17 +1721,26 @@ int SiteTimIntegrate(int (*lags)[2], int32_t rfreq) {
   double time_diff=0;
   struct tm tstruct;
   time_t ttime;
-  char filename[256];
-  struct ROSMsg smsg,rmsg;
+  struct ROSMsg smsg,rmsg,qmsg;
+  struct SiteTimMsgBatch batch;
+  struct SiteTimDataStatus dstat;
+  int setprm;
+  struct ROSMsg wmsg;
+  int32 wtime;
+  int ahead;
+  struct SiteTimSlot *rx;
+  int nseq=0; /* sequences with data taken from the ROS */
+  int newbeam;
+  int zcopy; /* samples are received straight into the IQ segment */
+  struct SiteTimSlot *pend=NULL; /* bulk part still on the data channel */
+  int bulk; /* bulk part of this sequence read with the reply */
+  unsigned long grown; /* buffer growth before the integration */
 
-  int iqoff=0; /* Sequence offset in bytes for current sequence relative to start of samples buffer*/
   int iqsze=0; /* Total number of bytes so far recorded into samples buffer*/
 
   int nave=0;
 
   int atstp=0.;
-  int thr=0,lmt=0;
-  int aflg=0,abflg=0;
 
   FILE *ftest=NULL;
   char test_file[255];
@@ -766,19 +1748,26 @@ int SiteTimIntegrate(int (*lags)[2], int32_t rfreq) {
   int temp;
   struct timespec time_now;
 
-  void *dest=NULL; /*AJ*/
   int total_samples=0; /*AJ*/
+  int acfsmp=0; /* samples per sequence used by the ACF */
+  int planar=0; /* sequences are stored as separate I and Q planes */
+  int plane=0; /* samples per plane */
+  int iqbase=0; /* bytes ahead of the first sequence */
+  int step=2;
+  int pooled=0; /* gates shared between the lag pool threads */
+  int streamed=0; /* ACFEX summed as each sequence arrives */
+  double acfexdpwr,acfexdacf; /* largest streamed ACFEX differences */
+  float acfexnoise;
+  int ndrop=0; /* sequences rejected by the screening */
+  int farsmp=0,farnum=0; /* samples the noise median is taken over */
+  int xgated=0; /* XCF restricted to the gates in xgate */
   int usecs;
-  short I,Q;
-  double phi_m,phi_i,phi_d;
-  int32 temp32;
-  /* phase code declarations */
-  int n,nsamp, *code,   Iout, Qout;
-  uint32 uI32,uQ32;
+  int n;
   if (debug) {
     fprintf(stderr,"%s SiteIntegrate: start\n",station);
   }
   SiteTimExit(0);
+  grown=SiteTimGrowCount();
   clock_gettime(CLOCK_REALTIME, &time_now);
   ttime=time_now.tv_sec;
   gmtime_r(&ttime,&tstruct);
@@ -842,59 +1831,105 @@ int SiteTimIntegrate(int (*lags)[2], int32_t rfreq) {
   }
 
   if (nrang>=MAX_RANGE) return -1;
-  for (j=0;j<LAG_SIZE;j++) lagsum[j]=0;
 
-  if (mplgexs==0) {
-    lagtable[0]=malloc(sizeof(int)*(mplgs+1));
-    if(lagtable[0]==NULL) {
-      fprintf(stderr,"Lagtable-0 is Null\n");
-      SiteTimExit(-1);
-    }
-    lagtable[1]=malloc(sizeof(int)*(mplgs+1));
-    if(lagtable[1]==NULL) {
-      fprintf(stderr,"Lagtable-1 is Null\n");
-      SiteTimExit(-1);
-    }
-    for (i=0;i<=mplgs;i++) {
-      lagtable[0][i]=lags[i][0];
-      lagtable[1][i]=lags[i][1];
-    }
-  } else {
-    lagtable[0]=malloc(sizeof(int)*(mplgexs+1));
-    if(lagtable[0]==NULL) {
-      fprintf(stderr,"Lagtable-0 is Null\n");
-      SiteTimExit(-1);
-    }
-    lagtable[1]=malloc(sizeof(int)*(mplgexs+1));
-    if(lagtable[1]==NULL) {
-      fprintf(stderr,"Lagtable-1 is Null\n");
-      SiteTimExit(-1);
-    }
-
-    for (i=0;i<=mplgexs;i++) {
-      lagtable[0][i]=lags[i][0];
-      lagtable[1][i]=lags[i][1];
-      j=abs(lags[i][0]-lags[i][1]);
-      lagsum[j]++;
+  /* The lag tables, sample counts and bad range come from the plan,
+     which is only rebuilt when the sequence or the lags change. */
+  if (SiteTimPlanLags(&plan,&tsgprm,lags,mplgs,mplgexs,nbaud,screen.nfar)<0) {
+    fprintf(stderr,"%s SiteIntegrate: no integration plan\n",station);
+    return -1;
+  }
+  lagtable[0]=plan.lagtable[0];
+  lagtable[1]=plan.lagtable[1];
+  lagsum=plan.lagsum;
+  badrng=plan.badrng;
+  acfsmp=plan.acfsmp;
+  rossmp=plan.rossmp;
+  usecs=plan.usecs;
+  farsmp=plan.farsmp;
+  farnum=plan.farnum;
+
+  total_samples=plan.total;
+  skpnum=plan.skpnum;  /*skpnum != 0  returns 1, which is used as the dflg argument in ACFCalculate to enable smdelay usage in offset calculations*/
+  smpnum=(mplgexs==0) ? acfsmp : total_samples;
+
+  /* The planar layout is only used for the standard ACF with a single
+     receiver channel, ACFEX works on the interleaved samples. Each plane
+     is padded so the next starts on the alignment boundary. */
+  if (iqhdr !=NULL) {
+    iqbase=iqhdr->hdrsze;
+    planar=(mplgexs==0) && (rxchn==1);
+    plane=0;
+    if (planar) {
+      n=SITEIQ_ALIGN/sizeof(int16);
+      plane=(acfsmp+n-1)/n*n;
     }
+    iqhdr->layout=(planar) ? SITEIQ_PLANAR : SITEIQ_INTERLEAVED;
+    iqhdr->plane=plane;
+    iqhdr->seqnum=0;
+    iqhdr->smpnum=smpnum;
+    iqhdr->chnnum=rxchn;
   }
-
-
-  total_samples=tsgprm.samples+tsgprm.smdelay;
-  smpnum=total_samples;
-  skpnum=tsgprm.smdelay;  /*skpnum != 0  returns 1, which is used as the dflg argument in ACFCalculate to enable smdelay usage in offset calculations*/
-  badrng=ACFBadLagZero(&tsgprm,mplgs,lagtable);
+  step=(planar) ? 1 : 2;
+  iqsze=iqbase;
 
   gettimeofday(&tick,NULL);
   gettimeofday(&tack,NULL);
 
-  for (i=0;i<MAX_RANGE;i++) {
-      pwr0[i]=0;
-      for (j=0;j<LAG_SIZE*2;j++) {
-        acfd[i*LAG_SIZE*2+j]=0;
-        xcfd[i*LAG_SIZE*2+j]=0;
+  /* The standard ACF sums into the compact accumulators, which are only
+     laid out again if the sequence has changed under them. The globals
+     outside the active ranges and lags stay clear from then on. */
+  if (mplgexs==0) {
+    if ((lagacc.nrang !=tsgprm.nrang) || (lagacc.mplgs !=mplgs)) {
+      if (SiteTimLagAccMake(&lagacc,tsgprm.nrang,mplgs) !=0) {
+        fprintf(stderr,"Lag accumulators are Null\n");
+        SiteTimExit(-1);
       }
+      SiteTimZeroACF();
+    } else SiteTimLagAccZero(&lagacc);
+  } else SiteTimZeroACF();
+
+  if (SiteTimPoolSize()>1) {
+    if (SiteTimPoolBegin(tsgprm.nrang,mplgs)==0) pooled=1;
+    else fprintf(stderr,"%s SiteIntegrate: lag pool unavailable, summing on one thread\n",station);
   }
+  /* stream the ACFEX sums when the site asks for it and they can hold
+     this lag table, otherwise this integration is left to
+     ACFexCalculate */
+  streamed=0;
+  if ((mplgexs !=0) && (acfexstream)) {
+    if (SiteTimACFexBegin(&acfex,tsgprm.nrang,mplgs,mplgexs,lagtable)==0)
+      streamed=1;
+    else fprintf(stderr,"%s SiteIntegrate: streaming ACFEX unavailable\n",station);
+  }
+
+  /* everything the sequence processing needs for this integration */
+  memset(&seqstate,0,sizeof(seqstate));
+  seqstate.iqoff=iqbase;
+  seqstate.iqsze=iqbase;
+  seqstate.planar=planar;
+  seqstate.plane=plane;
+  seqstate.step=step;
+  seqstate.acfsmp=acfsmp;
+  seqstate.farsmp=farsmp;
+  seqstate.farnum=farnum;
+  seqstate.lagtable[0]=lagtable[0];
+  seqstate.lagtable[1]=lagtable[1];
+  seqstate.badrng=badrng;
+  seqstate.atstp=atstp;
+  seqstate.pooled=pooled;
+  seqstate.streamed=streamed;
+
+  /* Decode and sum each sequence on the worker while the next one is
+     taken. The diagnostic and debug output assume the serial order so
+     keep it. */
+  SiteTimRingMode(&ring,(seqpipe) && (f_diagnostic_ascii==NULL) &&
+                  (debug==0));
+
+  /* With the sequences taken in order the samples can be received in
+     the IQ segment and decoded where they lie. The worker runs behind
+     the receive and the planes are split on the way across, so those
+     go through the slot buffers. */
+  zcopy=(ring.async==0) && (planar==0);
 
 /* Seq loop to trigger and collect data */
   while (1) {
@@ -903,21 +1938,14 @@ int SiteTimIntegrate(int (*lags)[2], int32_t rfreq) {
       clock_gettime(CLOCK_REALTIME, &time_now);
       ttime=time_now.tv_sec;
       gmtime_r(&ttime,&tstruct);
-      fprintf(f_diagnostic_ascii,"Sequence: START: %8d\n",nave);
+      fprintf(f_diagnostic_ascii,"Sequence: START: %8d\n",seqstate.nave);
       fprintf(f_diagnostic_ascii,"  sec: %8d nsec: %12ld\n",(int)time_now.tv_sec,time_now.tv_nsec);
     }
 
-    seqtval[nave].tv_sec=tick.tv_sec;
-    seqtval[nave].tv_nsec=tick.tv_usec*1000;
-    seqatten[nave]=0.;
-    seqnoise[nave]=0;
-    seqbadtr[nave].num=0;
-  
-
     tval=(tick.tv_sec+tick.tv_usec/1.0e6)-
          (tack.tv_sec+tack.tv_usec/1.0e6);
 
-    if (nave>0) tavg=tval/nave; 
+    if (nseq>0) tavg=tval/nseq; 
      
     tick.tv_sec+=floor(tavg);
     tick.tv_usec+=1.0e6*(tavg-floor(tavg));
@@ -926,8 +1954,8 @@ int SiteTimIntegrate(int (*lags)[2], int32_t rfreq) {
     time_diff+=(tick.tv_usec-tock.tv_usec)/1E6;
     /* Tests to break out of Integration loop */
     if (tock.tv_sec+tock.tv_usec==0) {
-      /*Integration not requested, break when nave > 0 */
-      if (nave > 0) break; 
+      /*Integration not requested, break after one sequence */
+      if (nseq > 0) break; 
     } else {
       /*Integration requested, break when elapsed time is greater than integration scan */
       if (time_diff > 0.0) {
@@ -936,438 +1964,227 @@ int SiteTimIntegrate(int (*lags)[2], int32_t rfreq) {
     }
 
 
-    rprm.tbeam=bmnum;   
-    rprm.tfreq=tfreq;   
+    /* rprm is the ROS's view, refreshed by every data reply, so the
+       request is built in prmwant and only goes to the ROS when it
+       differs from the last set the ROS took */
+    prmwant.tbeam=bmnum;   
+    prmwant.tfreq=tfreq;   
     if (rfreq < 0) { 
-      rprm.rfreq=tfreq;   
+      prmwant.rfreq=tfreq;   
     } else {
-      rprm.rfreq=rfreq;   
+      prmwant.rfreq=rfreq;   
     }
-    rprm.trise=5000;   
-    rprm.baseband_samplerate=((double)nbaud/(double)txpl)*1E6; 
-    rprm.filter_bandwidth=rprm.baseband_samplerate; 
-    rprm.match_filter=dmatch;
-    rprm.number_of_samples=total_samples+nbaud+10; 
-    rprm.priority=cnum;
-    rprm.buffer_index=0;  
-
-    usecs=(int)(rprm.number_of_samples/rprm.baseband_samplerate*1E6);
+    SiteTimPlanPrm(&plan,&prmwant);
     if (debug) {
-      fprintf(stderr,"%s SiteIntegrate: rfreq %d tfreq %d\n",station,rprm.rfreq,rprm.tfreq);
+      fprintf(stderr,"%s SiteIntegrate: rfreq %d tfreq %d\n",station,prmwant.rfreq,prmwant.tfreq);
     }
 
+    setprm=(prmok==0) || 
+           (memcmp(&prmwant,&prmlast,sizeof(struct ControlPRM)) !=0);
+
     smsg.type=SET_PARAMETERS;
-    TCPIPMsgSend(sock,&smsg,sizeof(struct ROSMsg));
-    TCPIPMsgSend(sock,&rprm,sizeof(struct ControlPRM));
-    TCPIPMsgRecv(sock,&rmsg,sizeof(struct ROSMsg));
-    if (debug) {
-      fprintf(stderr,"SET_PARAMETERS:type=%c\n",rmsg.type);
-      fprintf(stderr,"SET_PARAMETERS:status=%d\n",rmsg.status);
+    qmsg.type=SET_READY_FLAG;
+    SiteTimMsgBatchZero(&batch);
+    if (setprm) {
+      SiteTimMsgBatchAdd(&batch,&smsg,sizeof(struct ROSMsg));
+      SiteTimMsgBatchAdd(&batch,&prmwant,sizeof(struct ControlPRM));
+    }
+    /* the ready flag and the wait go out in the same write, the ROS
+       answers them in order */
+    wmsg.type=WAIT_FOR_DATA;
+    wtime=usecs+waitslack;
+    ahead=(rospipe) || (setprm==0);
+    if (ahead) {
+      SiteTimMsgBatchAdd(&batch,&qmsg,sizeof(struct ROSMsg));
+      if (waitdata) {
+        SiteTimMsgBatchAdd(&batch,&wmsg,sizeof(struct ROSMsg));
+        SiteTimMsgBatchAdd(&batch,&wtime,sizeof(int32));
+      }
+    }
+    SiteTimMsgBatchSend(sock,&batch);
+    if (setprm) {
+      SiteTimDataWait(&pend,zcopy);
+      TCPIPMsgRecv(sock,&rmsg,sizeof(struct ROSMsg));
+      SiteTimPrmSent(&prmwant,rmsg.status);
+      if (debug) {
+        fprintf(stderr,"SET_PARAMETERS:type=%c\n",rmsg.type);
+        fprintf(stderr,"SET_PARAMETERS:status=%d\n",rmsg.status);
+      }
+      if (rospipe==0) TCPIPMsgSend(sock,&qmsg,sizeof(struct ROSMsg));
     }
 
-
-
-    smsg.type=SET_READY_FLAG;
-    TCPIPMsgSend(sock,&smsg,sizeof(struct ROSMsg));
+    SiteTimDataWait(&pend,zcopy);
     TCPIPMsgRecv(sock,&rmsg,sizeof(struct ROSMsg));
     if (debug) {
       fprintf(stderr,"SET_READY_FLAG:type=%c\n",rmsg.type);
       fprintf(stderr,"SET_READY_FLAG:status=%d\n",rmsg.status);
     }
 
-usleep(usecs);
-
-/*  FIXME: This is not defined 
-    smsg.type=WAIT_FOR_DATA;
-    TCPIPMsgSend(sock,&smsg,sizeof(struct ROSMsg));
-    TCPIPMsgRecv(sock,&rmsg,sizeof(struct ROSMsg));
-    if (debug) {
-      fprintf(stderr,"SET_READY_FLAG:type=%c\n",rmsg.type);
-      fprintf(stderr,"SET_READY_FLAG:status=%d\n",rmsg.status);
+    /* the next sequence is under way, take the samples of the last one
+       off the data channel while it runs */
+    if (pend !=NULL) {
+      SiteTimDataRecv(pend,zcopy);
+      SiteTimRingPush(&ring);
+      pend=NULL;
     }
-*/
 
+    if (waitdata) {
+      /* the reply comes when the samples are in or after wtime, in
+         which case GET_DATA waits for them as before */
+      if (ahead==0) {
+        SiteTimMsgBatchAdd(&batch,&wmsg,sizeof(struct ROSMsg));
+        SiteTimMsgBatchAdd(&batch,&wtime,sizeof(int32));
+        SiteTimMsgBatchSend(sock,&batch);
+      }
+      TCPIPMsgRecv(sock,&rmsg,sizeof(struct ROSMsg));
+      if (debug) {
+        fprintf(stderr,"WAIT_FOR_DATA:type=%c\n",rmsg.type);
+        fprintf(stderr,"WAIT_FOR_DATA:status=%d\n",rmsg.status);
+      }
+      if (rmsg.status !=1) fprintf(stderr,"%s WAIT_FOR_DATA: no data after %d us\n",
+                                   station,wtime);
+    } else usleep(usecs);
+
+    /* the reply goes into the next free slot of the ring, which waits
+       here if the worker is a whole ring behind */
+    rx=SiteTimRingClaim(&ring);
     smsg.type=GET_DATA;
-    if (rdata.main!=NULL) free(rdata.main);
-    if (rdata.back!=NULL) free(rdata.back);
-    rdata.main=NULL;
-    rdata.back=NULL;
-    TCPIPMsgSend(sock,&smsg,sizeof(struct ROSMsg));
+    qmsg.type=GET_PARAMETERS;
+    SiteTimMsgBatchZero(&batch);
+    SiteTimMsgBatchAdd(&batch,&smsg,sizeof(struct ROSMsg));
+    /* ask for the parameters now, they are read after the data; with
+       the data status on the reply already says which beam was used */
+    if ((rospipe) && (datastatus==0)) 
+      SiteTimMsgBatchAdd(&batch,&qmsg,sizeof(struct ROSMsg));
+    SiteTimMsgBatchSend(sock,&batch);
     if (debug) {
       fprintf(stderr,"%s GET_DATA: recv dprm\n",station);
     }
-    TCPIPMsgRecv(sock,&dprm,sizeof(struct DataPRM));
-    if(rdata.main) free(rdata.main);
-    if(rdata.back) free(rdata.back);
+    TCPIPMsgRecv(sock,&rx->dprm,sizeof(struct DataPRM));
     if (debug) 
-        fprintf(stderr,"%s GET_DATA: samples %d status %d\n",station,dprm.samples,dprm.status);
+        fprintf(stderr,"%s GET_DATA: samples %d status %d\n",station,rx->dprm.samples,rx->dprm.status);
       
-    if(dprm.status==0) {
-      if (debug) {
-        fprintf(stderr,"%s GET_DATA: rdata.main: uint32: %ld array: %ld\n",station,sizeof(uint32),sizeof(uint32)*dprm.samples);
-      }
-      rdata.main=malloc(sizeof(uint32)*dprm.samples);
-      rdata.back=malloc(sizeof(uint32)*dprm.samples);
-      if (debug) {
-        fprintf(stderr,"%s GET_DATA: recv main\n",station);
-      }
-      TCPIPMsgRecv(sock, rdata.main, sizeof(uint32)*dprm.samples);
-      if (debug) {
-        fprintf(stderr,"%s GET_DATA: recv back\n",station);
-      }
-      TCPIPMsgRecv(sock, rdata.back, sizeof(uint32)*dprm.samples);
-
-      if (badtrdat.start_usec !=NULL) free(badtrdat.start_usec);
-      if (badtrdat.duration_usec !=NULL) free(badtrdat.duration_usec);
-      badtrdat.start_usec=NULL;
-      badtrdat.duration_usec=NULL;
-      if (debug) {
-        fprintf(stderr,"%s GET_DATA: trtimes length %d\n",station,badtrdat.length);
+    rx->badtr.length=0;
+    rx->ntx=0;
+    rx->inring=0;
+    bulk=0;
+    if(rx->dprm.status==0) {
+      if (roslink.ring !=NULL) {
+        /* the samples are already in the ROS ring, only the slot comes */
+        TCPIPMsgRecv(sock, &rx->ringseq, sizeof(uint32));
+        rx->main=SiteTimLinkSlot(&roslink,rx->ringseq,rx->dprm.samples);
+        if (rx->main==NULL) {
+          fprintf(stderr,"%s GET_DATA: %d samples do not fit the ring\n",
+                  station,rx->dprm.samples);
+          SiteTimExit(-1);
+        }
+        rx->back=rx->main+rx->dprm.samples;
+        rx->inring=1;
       }
-      TCPIPMsgRecv(sock, &badtrdat.length, sizeof(badtrdat.length));
+      /* without a data channel the bulk part sits here in the reply,
+         with one it is read here only if the ROS is waiting on it */
+      if (dsock==sock) {
+        SiteTimDataRecv(rx,zcopy);
+        bulk=1;
+      } else bulk=SiteTimDataAhead(rx,zcopy);
+      TCPIPMsgRecv(sock, &rx->ntx, sizeof(int));
+      TCPIPMsgRecv(sock, &rx->tx.AGC, sizeof(int)*rx->ntx);
+      TCPIPMsgRecv(sock, &rx->tx.LOWPWR, sizeof(int)*rx->ntx);
+      num_transmitters=rx->ntx;
+    }
+    if (datastatus) {
+      TCPIPMsgRecv(sock, &dstat, sizeof(struct SiteTimDataStatus));
+      rprm.tbeam=dstat.tbeam;
+      rprm.tfreq=dstat.tfreq;
+      rprm.rfreq=dstat.rfreq;
+      rprm.status=dstat.status;
       if (debug) 
-        fprintf(stderr,"%s GET_DATA: badtrdat.start_usec: uint32: %ld array: %ld\n",station,sizeof(uint32),sizeof(uint32)*badtrdat.length);
-      badtrdat.start_usec=malloc(sizeof(uint32)*badtrdat.length);
-      badtrdat.duration_usec=malloc(sizeof(uint32)*badtrdat.length);
-      if (debug) {
-        fprintf(stderr,"%s GET_DATA: start_usec\n",station);
-      }
-      TCPIPMsgRecv(sock, badtrdat.start_usec,
-                 sizeof(uint32)*badtrdat.length);
-      if (debug) {
-        fprintf(stderr,"%s GET_DATA: duration_usec\n",station);
-      }
-      TCPIPMsgRecv(sock, badtrdat.duration_usec,
-                 sizeof(uint32)*badtrdat.length);
-      TCPIPMsgRecv(sock, &num_transmitters, sizeof(int));
-      TCPIPMsgRecv(sock, &txstatus.AGC, sizeof(int)*num_transmitters);
-      TCPIPMsgRecv(sock, &txstatus.LOWPWR, sizeof(int)*num_transmitters);
+        fprintf(stderr,"%s GET_DATA: tbeam %d tfreq %d\n",station,
+                dstat.tbeam,dstat.tfreq);
     }
     TCPIPMsgRecv(sock, &rmsg, sizeof(struct ROSMsg));
     if (debug) {
       fprintf(stderr,"%s GET_DATA:type=%c\n",station,rmsg.type);
       fprintf(stderr,"%s GET_DATA:status=%d\n",station,rmsg.status);
     }
-    smsg.type=GET_PARAMETERS;
-    TCPIPMsgSend(sock, &smsg, sizeof(struct ROSMsg));
-    TCPIPMsgRecv(sock, &rprm, sizeof(struct ControlPRM));
-    TCPIPMsgRecv(sock, &rmsg, sizeof(struct ROSMsg));
+    if (datastatus==0) {
+      if (rospipe==0) TCPIPMsgSend(sock, &qmsg, sizeof(struct ROSMsg));
+      if ((bulk==0) && (rx->dprm.status==0)) 
+        bulk=SiteTimDataAhead(rx,zcopy);
+      TCPIPMsgRecv(sock, &rprm, sizeof(struct ControlPRM));
+      TCPIPMsgRecv(sock, &rmsg, sizeof(struct ROSMsg));
+      if (debug) {
+        fprintf(stderr,"%s GET_PARAMETERS:type=%c\n",station,rmsg.type);
+        fprintf(stderr,"%s GET_PARAMETERS:status=%d\n",station,rmsg.status);
+      }
+    }
+    dprm=rx->dprm;
     if (debug) {
-      fprintf(stderr,"%s GET_PARAMETERS:type=%c\n",station,rmsg.type);
-      fprintf(stderr,"%s GET_PARAMETERS:status=%d\n",station,rmsg.status);
       fprintf(stderr,"%s Number of samples: dprm.samples:%d tsprm.samples:%d total_samples:%d\n",station,dprm.samples,tsgprm.samples,total_samples);
-      fprintf(stderr,"%s nave=%d\n",station,nave);
+      fprintf(stderr,"%s nseq=%d\n",station,nseq);
       fprintf(stderr,"%s dprm.status=%d\n",station,dprm.status);
     }
-    ttime=dprm.event_secs;
-    if ( ttime < 100 ) {
-      ttime=time_now.tv_sec;
-    }
-    gmtime_r(&ttime,&tstruct);
-    if(seqlog_dir!=NULL) { 
-      sprintf(filename,"%s/seqlog.%s%s.%04d%02d%02d",seqlog_dir,station,channame,tstruct.tm_year+1900,tstruct.tm_mon+1,tstruct.tm_mday);
-      if(strcmp(filename,seqlog_name)!=0) {
-        strcpy(seqlog_name,filename);
-        if (seqlog!=NULL) {
-          fflush(seqlog);
-          fclose(seqlog);
-          seqlog=NULL;
-        }
-        fprintf(stdout,"seqlog filename: %s\n",seqlog_name);
-        seqlog=fopen(seqlog_name,"a+");
-        fflush(stdout);
-      }
-    }
-    if (seqlog!=NULL) {
-      fwrite(&dprm.event_secs,sizeof(int32),1,seqlog);
-      temp32=floor(dprm.event_nsecs/1000); 
-      fwrite(&temp32,sizeof(int32),1,seqlog);
-      fwrite(&rprm.tbeam,sizeof(int32),1,seqlog);
-      fwrite(&rprm.tfreq,sizeof(int32),1,seqlog);
-      fwrite(&badtrdat.length,sizeof(int32),1,seqlog);
-      for(i=0;i<badtrdat.length;i++) {
-        temp32=badtrdat.start_usec[i]; 
-        fwrite(&temp32,sizeof(int32),1,seqlog);
-        temp32=badtrdat.duration_usec[i]; 
-        fwrite(&temp32,sizeof(int32),1,seqlog);
-      }
-    }
-    if(f_diagnostic_ascii!=NULL) {
-        fprintf(f_diagnostic_ascii,"** TX: ");
-        for(i=0;i<num_transmitters;i++)
-          fprintf(f_diagnostic_ascii,"%3d ",i);
-        fprintf(f_diagnostic_ascii,"\n");
-        fprintf(f_diagnostic_ascii,"  AGC: ");
-        for(i=0;i<num_transmitters;i++)
-          fprintf(f_diagnostic_ascii,"%3d ",( 1 ^ txstatus.AGC[i]));
-        fprintf(f_diagnostic_ascii,"\n");
-        fprintf(f_diagnostic_ascii,"  LOW: ");
-        for(i=0;i<num_transmitters;i++)
-          fprintf(f_diagnostic_ascii,"%3d ",txstatus.LOWPWR[i]);
-        fprintf(f_diagnostic_ascii,"\n");
-    }
-
 
-    if(nave==0) {
+    if(nseq==0) {
       bmnum=rprm.tbeam;
       tfreq=rprm.tfreq;
     }
-    if (rprm.tbeam != bmnum) {
+    newbeam=(rprm.tbeam != bmnum);
+    rx->tbeam=rprm.tbeam;
+    rx->tfreq=rprm.tfreq;
+    rx->newbeam=newbeam;
+    rx->tick=tick;
+    if (dprm.status==0) nseq++;
+
+    /* from here the slot belongs to the worker. With a data channel
+       its bulk part is only read once the next sequence is armed,
+       unless there is no next one or the ROS is already waiting on it. */
+    if ((bulk==0) && (rx->dprm.status==0) && (newbeam==0)) pend=rx;
+    else {
+      if ((bulk==0) && (rx->dprm.status==0)) SiteTimDataRecv(rx,zcopy);
+      SiteTimRingPush(&ring);
+    }
+    if (newbeam) {
       fprintf(stderr,"New beam :: end integration\n");
       fflush(stderr);
       break;
-    } else {
-    }
-
-/* JDS : For testing only */
-/*
-    dprm.status=0;
-    dprm.samples=0;
-    if (rdata.main!=NULL) free(rdata.main);
-    if (rdata.back!=NULL) free(rdata.back);
-    rdata.main=NULL;
-    rdata.back=NULL;
-    rdata.main=malloc(sizeof(uint32)*dprm.samples);
-    rdata.back=malloc(sizeof(uint32)*dprm.samples);
-    badtrdat.length=0;
-*/
-/* JDS: End testing block */
-    code=pcode;
-    if(f_diagnostic_ascii!=NULL) {
-      fprintf(f_diagnostic_ascii,"Sequence: Parameters: START\n");
-      fprintf(f_diagnostic_ascii,"  bmnum=%8d nbaud=%8d txpl=%8d tfreq=%8d code=", bmnum, nbaud, txpl,tfreq);
-      for(i=0;i<nbaud;i++){
-        if (code!=NULL)
-          fprintf(f_diagnostic_ascii,"%8d,", code[i]);
-        else
-          fprintf(f_diagnostic_ascii,"%8d,", 1);
-      }
-      fprintf(f_diagnostic_ascii,"\n");
-      fprintf(f_diagnostic_ascii,"Sequence: Parameters: END\n");
-      fprintf(f_diagnostic_ascii,"Sequence: Invert %d\n",invert);
-    }
-
-    if(dprm.status==0) {
-      nsamp=(int)dprm.samples;
-     
-      if(invert!=0) {
-        for(n=0;n<nsamp;n++){
-          Q=(short)((rdata.main[n] & 0xffff0000) >> 16);
-          I=(short)(rdata.main[n] & 0x0000ffff);
-          Q=-Q;
-          I=-I;
-          uQ32=((uint32) Q) << 16;
-          uI32=((uint32) I) & 0xFFFF;
-          (rdata.main)[n]=uQ32|uI32;
-        }
-      }
-/*
-      fp=f_diagnostic_ascii;
-      f_diagnostic_ascii=stderr;
-*/
-      if(f_diagnostic_ascii!=NULL) {
-        fprintf(f_diagnostic_ascii,"Sequence : Raw Data : START\n");
-        fprintf(f_diagnostic_ascii,"  nsamp: %8d\n",nsamp);
-        fprintf(f_diagnostic_ascii,"index I_m Q_m I_m^2+Q_m^2 phi_m I_i Q_i I_i^2+Q_i^2 phi_i phi_d\n");
-        for(n=0;n<nsamp;n++){
-          Q=(short)((rdata.main[n] & 0xffff0000) >> 16);
-          I=(short)(rdata.main[n] & 0x0000ffff);
-          phi_m=atan2(Q,I);
-          if(f_diagnostic_ascii!=NULL) {
-            fprintf(f_diagnostic_ascii,"%8d %8d %8d %8d %8.3lf ", n, I, Q, (int)(I*I+Q*Q), phi_m);
-           }
-          Q=(short)((rdata.back[n] & 0xffff0000) >> 16);
-          I=(short)(rdata.back[n] & 0x0000ffff);
-          phi_i=atan2(Q,I);
-          phi_d=phi_i-phi_m;
-          if(phi_d >=  M_PI ) phi_d=phi_d-(2.*M_PI);
-          if(phi_d < -M_PI ) phi_d=phi_d+(2.*M_PI);
-          if(f_diagnostic_ascii!=NULL) {
-            fprintf(f_diagnostic_ascii,"%8d %8d %8d %8.3lf %8.3lf\n", I, Q, (int)(I*I+Q*Q),phi_i,phi_d);
-          }
-        }
-        fprintf(f_diagnostic_ascii,"Sequence: Raw Data: END\n");
-      }
-/*
-      f_diagnostic_ascii=fp;
-*/
-    /* decode phase coding here */
-      if(nbaud>1){
-        if(f_diagnostic_ascii!=NULL) {
-            fprintf(f_diagnostic_ascii,"PCODE: DECODE_START\n");
-            fprintf(f_diagnostic_ascii,"nsamp: %8d\n",nsamp);
-        }
-
-        nsamp=(int)dprm.samples;
-        code=pcode;
-        for(n=0;n<(nsamp-nbaud);n++){
-          Iout=0;
-          Qout=0;
-          for(i=0;i<nbaud;i++){
-            Q=((rdata.main)[n+i] & 0xffff0000) >> 16;
-            I=(rdata.main)[n+i] & 0x0000ffff;
-            Iout+=(int)I*(int)code[i];
-            Qout+=(int)Q*(int)code[i];
-          }
-
-          Iout/=nbaud;
-          Qout/=nbaud;
-          I=(short)Iout;
-          Q=(short)Qout;
-
-          if(f_diagnostic_ascii!=NULL) {
-            fprintf(f_diagnostic_ascii,"%8d %8d %8d %8d ", n, I, Q, (int)sqrt(I*I+Q*Q));
-          }
-          uQ32=((uint32) Q) << 16;
-          uI32=((uint32) I) & 0xFFFF;
-          (rdata.main)[n]=uQ32|uI32;
-                
-
-          Iout=0;
-          Qout=0;
-          for(i=0;i<nbaud;i++){
-            Q=((rdata.back)[n+i] & 0xffff0000) >> 16;
-            I=(rdata.back)[n+i] & 0x0000ffff;
-            Iout+=(int)I*(int)code[i];
-            Qout+=(int)Q*(int)code[i];
-          }
-          Iout/=nbaud;
-          Qout/=nbaud;
-          I=(short)Iout;
-          Q=(short)Qout;
-          if(f_diagnostic_ascii!=NULL) {
-            fprintf(f_diagnostic_ascii,"%8d %8d %8d\n", I, Q, (int)sqrt(I*I+Q*Q));
-          }
-          uQ32=((uint32) Q) << 16;
-          uI32=((uint32) I) & 0xFFFF;
-          (rdata.back)[n]=uQ32|uI32;
-        }
-        if(f_diagnostic_ascii!=NULL) fprintf(f_diagnostic_ascii,"PCODE: DECODE_END\n");
-
-      } else {
-      }
-/*
-      if(dprm.samples<total_samples) {
-        fprintf(stderr,"Not enough  samples from the ROS in SiteIntegrate\n");
-        fflush(stderr);
-      }
-*/
-    /* copy samples here */
-
-      seqoff[nave]=iqsze/2;/*Sequence offset in 16bit units */
-      seqsze[nave]=dprm.samples*2*2; /* Sequence length in 16bit units */
-
-      if(seqbadtr[nave].start!=NULL)  free(seqbadtr[nave].start);
-      if(seqbadtr[nave].length!=NULL) free(seqbadtr[nave].length);
-      seqbadtr[nave].start=NULL;
-      seqbadtr[nave].length=NULL;
-      seqbadtr[nave].num=badtrdat.length;
-      seqbadtr[nave].start=malloc(sizeof(uint32)*badtrdat.length);
-      seqbadtr[nave].length=malloc(sizeof(uint32)*badtrdat.length);
-
-      memcpy(seqbadtr[nave].start,badtrdat.start_usec,
-           sizeof(uint32)*badtrdat.length);
-      memcpy(seqbadtr[nave].length,badtrdat.duration_usec,
-           sizeof(uint32)*badtrdat.length);
-
-/* AJ new way, does work for some reason */
-/* samples is natively an int16 pointer */
-/* rdata.main is natively an uint32 pointer */
-/* rdata.back is natively an uint32 pointer */
-/* total_samples*8 represents number of bytes for main and back samples */
-
-      
-      dest = (void *)(samples);  /* look iqoff bytes into samples area */
-      dest+=iqoff;
-      if ((iqoff+dprm.samples*2*sizeof(uint32) )<iqbufsize) {
-        memmove(dest,rdata.main,dprm.samples*sizeof(uint32));
-        dest += dprm.samples*sizeof(uint32); /* skip ahead number of samples * 32 bit per sample to account for rdata.main*/
-        memmove(dest,rdata.back,dprm.samples*sizeof(uint32));
-      } else {
-        fprintf(stderr,"IQ Buffer overrun in SiteIntegrate\n");
-        fflush(stderr);
-      }
-      iqsze+=dprm.samples*sizeof(uint32)*2;  /*  Total of number bytes so far copied into samples array */
-      if (debug) {
-        fprintf(stderr,"%s seq %d :: ioff: %8d\n",station,nave,iqoff);
-        fprintf(stderr,"%s seq %d :: rdata.main 16bit :\n",station,nave);
-        fprintf(stderr," [  n  ] :: [  Im  ] [  Qm  ] :: [ Ii ] [ Qi ]\n");
-        nsamp=(int)dprm.samples;
-        for(n=0;n<(nsamp);n++){
-          Q=((rdata.main)[n] & 0xffff0000) >> 16;
-          I=(rdata.main)[n] & 0x0000ffff;
-          fprintf(stderr," %7d :: %7d %7d ",n,(int)I,(int)Q);
-          Q=((rdata.back)[n] & 0xffff0000) >> 16;
-          I=(rdata.back)[n] & 0x0000ffff;
-          fprintf(stderr,":: %7d %7d\n",(int)I,(int)Q);
-        }
-        dest = (void *)(samples);
-        dest += iqoff;
-        fprintf(stderr,"%s seq %d :: rdata.back 16bit 30: %8d %8d\n",station,nave,
-           ((int16 *)rdata.back)[60],((int16 *)rdata.back)[61]);
-        dest += dprm.samples*sizeof(uint32);
-        fprintf(stderr,"%s seq %d :: samples    16bit 30: %8d %8d\n",station,nave,
-           ((int16 *)dest)[60],((int16 *)dest)[61]);
-        fprintf(stderr,"%s seq %d :: iqsze: %8d\n",station,nave,iqsze);
-      }
-
-    /* calculate ACF */   
-      if (mplgexs==0) {
-        dest = (void *)(samples);
-        dest += iqoff;
-        rngoff=2*rxchn; 
-        if (debug) 
-        fprintf(stderr,"%s seq %d :: rngoff %d rxchn %d\n",station,nave,rngoff,rxchn);
-        if (debug) 
-        fprintf(stderr,"%s seq %d :: ACFSumPower\n",station,nave);
-        aflg=ACFSumPower(&tsgprm,mplgs,lagtable,pwr0,
-		     (int16 *) dest,rngoff,skpnum!=0,
-                     roff,ioff,badrng,
-                     noise,mxpwr,seqatten[nave]*atstp,
-                     thr,lmt,&abflg);
-        if (debug) 
-        fprintf(stderr,"%s seq %d :: rngoff %d rxchn %d\n",station,nave,rngoff,rxchn);
-        if (debug) 
-        fprintf(stderr,"%s seq %d :: ACFCalculate acf\n",station,nave);
-        ACFCalculate(&tsgprm,(int16 *) dest,rngoff,skpnum!=0,
-          roff,ioff,mplgs,lagtable,acfd,ACF_PART,2*dprm.samples,badrng,seqatten[nave]*atstp,NULL);
-        if (xcf ==1 ){
-          if (debug) 
-            fprintf(stderr,"%s seq %d :: rngoff %d rxchn %d\n",station,nave,rngoff,rxchn);
-          if (debug) 
-            fprintf(stderr,"%s seq %d :: ACFCalculate xcf\n",station,nave);
-          ACFCalculate(&tsgprm,(int16 *) dest,rngoff,skpnum!=0,
-                    roff,ioff,mplgs,lagtable,xcfd,XCF_PART,2*dprm.samples,badrng,seqatten[nave]*atstp,NULL);
-        }
-        if ((nave>0) && (seqatten[nave] !=seqatten[nave])) {
-        if (debug) 
-        fprintf(stderr,"%s seq %d :: rngoff %d rxchn %d\n",station,nave,rngoff,rxchn);
-        if (debug) 
-          fprintf(stderr,"%s seq %d :: ACFNormalize\n",station,nave);
-              ACFNormalize(pwr0,acfd,xcfd,tsgprm.nrang,mplgs,atstp); 
-        }  
-        if (debug) 
-        fprintf(stderr,"%s seq %d :: rngoff %d rxchn %d\n",station,nave,rngoff,rxchn);
-
-
-      }
-      nave++;
-      iqoff=iqsze;  /* set the offset bytes for the next sequence */
-
-    } else {
     }
     gettimeofday(&tick,NULL);
-    if(f_diagnostic_ascii!=NULL) fprintf(f_diagnostic_ascii,"Sequence: END\n");
-
+  }
 
+  if (pend !=NULL) {
+    SiteTimDataRecv(pend,zcopy);
+    SiteTimRingPush(&ring);
   }
+
+  /* wait for the worker to finish the sequences still in the ring */
+  SiteTimRingDrain(&ring);
+  nave=seqstate.nave;
+  ndrop=seqstate.ndrop;
+  iqsze=seqstate.iqsze;
+  xgated=seqstate.xgated;
+
   if(seqlog!=NULL) fflush(seqlog);
+  if (ndrop>0)
+    fprintf(stderr,"%s SiteIntegrate: %d sequences dropped by screening\n",
+            station,ndrop);
 
   /* Now divide by nave to get the average pwr0 and acfd values for the 
      integration period */ 
 
    if (mplgexs==0) {
 
+     /* collect the per thread accumulators, convert the exact sums to
+        floats and copy to the global layout, once for the integration */
+     if (pooled) SiteTimPoolEnd(&lagacc,xcf==1);
+     SiteTimLagAccCopy(&lagacc,pwr0,acfd,xcfd);
+     /* the gates that lost their XCF only hold the first few sequences */
+     if (xgated) {
+       for (i=0;i<tsgprm.nrang;i++) {
+         if (xgate[i]) continue;
+         memset(xcfd+i*2*mplgs,0,sizeof(float)*2*mplgs);
+       }
+     }
      if (nave > 0 ) {
        ACFAverage(pwr0,acfd,xcfd,nave,tsgprm.nrang,mplgs);
 /*
@@ -1383,19 +2200,32 @@ usleep(usecs);
        }
 */
      }
+   } else if ((nave>0) && (streamed) && (acfexstream==2)) {
+     /* the sums are already in, just normalise */
+     SiteTimACFexEnd(&acfex,pwr0,acfd,&noise);
    } else if (nave>0) {
      /* ACFEX calculation */
-     ACFexCalculate(&tsgprm,(int16 *) samples,nave*smpnum,nave,smpnum,
+     ACFexCalculate(&tsgprm,(int16 *) samples+iqbase/2,nave*smpnum,nave,smpnum,
                    roff,ioff,
                    mplgs,mplgexs,lagtable,lagsum,
                    pwr0,acfd,&noise);
+     /* the streamed sums cover the same sequences, see how far they
+        are from the library */
+     if ((streamed) &&
+         (SiteTimACFexCheck(&acfex,pwr0,acfd,&acfexdpwr,&acfexdacf,
+                            &acfexnoise)==0))
+       fprintf(stderr,"%s SiteIntegrate: ACFEX stream check: pwr0 %g acf %g noise %g library %g\n",
+               station,acfexdpwr,acfexdacf,acfexnoise,noise);
    }
-   free(lagtable[0]);
-   free(lagtable[1]);
    if (debug) {
      fprintf(stderr,"%s SiteIntegrate: iqsize in bytes: %ld in 16bit samples:  %ld in 32bit samples: %ld\n",station,(long int)iqsze,(long int)iqsze/2,(long int)iqsze/4);
      fprintf(stderr,"%s SiteIntegrate: end: nave: %d\n",station,nave);
    }
+   /* after the first integration of each sequence this should be zero */
+   grown=SiteTimGrowCount()-grown;
+   if ((grown>0) || (debug)) 
+     fprintf(stderr,"%s SiteIntegrate: buffers grown: %lu total: %lu\n",
+             station,grown,SiteTimGrowCount());
    if(f_diagnostic_ascii!=NULL) fprintf(f_diagnostic_ascii,"SiteIntegrate: END\n");
    if(f_diagnostic_ascii!=NULL){
      fclose(f_diagnostic_ascii);
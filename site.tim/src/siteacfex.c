@@ -0,0 +1,174 @@
+/* siteacfex.c
+   ===========
+*/
+/*
+ $License$
+*/
+
+/* Streaming extended lag (ACFEX) accumulation.
+ *
+ * The extended lag table lists every pulse pair of the sequence, so
+ * several pairs fall on the same lag; lagsum counts them. Rather than
+ * leaving all the sequences in the IQ buffer for one pass at the end
+ * of the integration, each sequence is folded into running double
+ * precision sums per range and lag as soon as it is decoded. The end
+ * of the integration then only has to divide each sum by the number of
+ * pairs that went into it and estimate the noise.
+ *
+ * A pair written with the later pulse first gives the conjugate
+ * product, so it is conjugated before being added to its lag. Pairs
+ * whose samples fall outside the sequence are not added, and as the
+ * pairs are counted for each range and lag the far ranges they leave
+ * out are still averaged over what they did get. A lag table reaching
+ * past mplgs cannot be held here at all, so SiteTimACFexBegin turns it
+ * down and the integration is left to ACFexCalculate.
+ *
+ * ACFexCalculate has its own normalisation and noise estimate, which
+ * these sums follow but need not match exactly. SiteTimACFexCheck sets
+ * the two side by side on the same samples so a site can see how far
+ * apart they are before using the sums in place of the library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rtypes.h"
+#include "tsg.h"
+#include "sitemem.h"
+#include "siteacfex.h"
+
+#define ACFEX_NOISE_RANGES 10 /* weakest ranges averaged for the noise */
+
+int SiteTimACFexBegin(struct SiteTimACFex *ptr,int nrang,int mplgs,
+                      int mplgexs,int *lagtable[2]) {
+  int i;
+
+  if ((nrang<=0) || (mplgs<=0)) return -1;
+  for (i=0;i<=mplgexs;i++) 
+    if (abs(lagtable[1][i]-lagtable[0][i])>=mplgs) return -1;
+
+  if ((SiteTimGrow((void **) &ptr->acf,&ptr->acfmax,nrang*2*mplgs,
+                   sizeof(double)) !=0) ||
+      (SiteTimGrow((void **) &ptr->count,&ptr->countmax,nrang*mplgs,
+                   sizeof(int)) !=0) ||
+      (SiteTimGrow((void **) &ptr->sort,&ptr->sortmax,nrang,
+                   sizeof(float)) !=0) ||
+      (SiteTimGrow((void **) &ptr->pwr0,&ptr->pwrmax,nrang,
+                   sizeof(float)) !=0) ||
+      (SiteTimGrow((void **) &ptr->acfd,&ptr->acfdmax,nrang*2*mplgs,
+                   sizeof(float)) !=0)) return -1;
+  ptr->nrang=nrang;
+  ptr->mplgs=mplgs;
+  ptr->nave=0;
+  memset(ptr->acf,0,sizeof(double)*nrang*2*mplgs);
+  memset(ptr->count,0,sizeof(int)*nrang*mplgs);
+  return 0;
+}
+
+int SiteTimACFexAdd(struct SiteTimACFex *ptr,struct TSGprm *prm,
+                    int16 *inbuf,int insamp,int rngoff,int dflg,
+                    int roffset,int ioffset,int mplgexs,int *lagtable[2]) {
+  int i,range,lag;
+  int sdelay=0;
+  int sampleunit;
+  int s1,s2;
+  double r1,i1,r2,i2;
+  double real,imag;
+  double *acf;
+
+  if (ptr->acf==NULL) return -1;
+  if (dflg) sdelay=prm->smdelay;
+  sampleunit=prm->mpinc/prm->smsep;
+
+  for (i=0;i<=mplgexs;i++) {
+    lag=abs(lagtable[1][i]-lagtable[0][i]);
+    if (lag>=ptr->mplgs) return -1;
+    for (range=0;range<ptr->nrang;range++) {
+      s1=lagtable[0][i]*sampleunit+range+sdelay;
+      s2=lagtable[1][i]*sampleunit+range+sdelay;
+      if ((s1>=insamp) || (s2>=insamp)) break;
+      r1=inbuf[s1*rngoff+roffset];
+      i1=inbuf[s1*rngoff+ioffset];
+      r2=inbuf[s2*rngoff+roffset];
+      i2=inbuf[s2*rngoff+ioffset];
+      real=r1*r2+i1*i2;
+      imag=r1*i2-r2*i1;
+      if (lagtable[0][i]>lagtable[1][i]) imag=-imag;
+      acf=ptr->acf+range*2*ptr->mplgs+2*lag;
+      acf[0]+=real;
+      acf[1]+=imag;
+      ptr->count[range*ptr->mplgs+lag]++;
+    }
+  }
+  ptr->nave++;
+  return 0;
+}
+
+static int ACFexCompare(const void *a,const void *b) {
+  float x=*(const float *) a;
+  float y=*(const float *) b;
+  if (x<y) return -1;
+  if (x>y) return 1;
+  return 0;
+}
+
+int SiteTimACFexEnd(struct SiteTimACFex *ptr,
+                    float *pwr0,float *acfd,float *noise) {
+  int range,lag,n;
+  double norm;
+  double sum=0;
+
+  if ((ptr->acf==NULL) || (ptr->nave==0)) return -1;
+
+  for (range=0;range<ptr->nrang;range++) {
+    for (lag=0;lag<ptr->mplgs;lag++) {
+      n=range*2*ptr->mplgs+2*lag;
+      norm=ptr->count[range*ptr->mplgs+lag];
+      if (norm<=0) {
+        acfd[n]=0;
+        acfd[n+1]=0;
+        continue;
+      }
+      acfd[n]=ptr->acf[n]/norm;
+      acfd[n+1]=ptr->acf[n+1]/norm;
+    }
+    pwr0[range]=acfd[range*2*ptr->mplgs];
+  }
+
+  if (noise==NULL) return 0;
+  memcpy(ptr->sort,pwr0,sizeof(float)*ptr->nrang);
+  qsort(ptr->sort,ptr->nrang,sizeof(float),ACFexCompare);
+  for (n=0;(n<ACFEX_NOISE_RANGES) && (n<ptr->nrang);n++) sum+=ptr->sort[n];
+  *noise=sum/n;
+  return 0;
+}
+
+/* Normalise the sums into the scratch arrays and compare them with the
+   pwr0, acfd and noise ACFexCalculate gave for the same sequences. The
+   largest lag-0 power difference relative to the library's power and
+   the largest ACF difference relative to the library's lag-0 power of
+   the same range are returned, with the streamed noise estimate. */
+
+int SiteTimACFexCheck(struct SiteTimACFex *ptr,
+                      float *pwr0,float *acfd,
+                      double *dpwr,double *dacf,float *noise) {
+  int range,n;
+  double p,d;
+
+  *dpwr=0;
+  *dacf=0;
+  if (SiteTimACFexEnd(ptr,ptr->pwr0,ptr->acfd,noise) !=0) return -1;
+
+  for (range=0;range<ptr->nrang;range++) {
+    p=fabs(pwr0[range]);
+    if (p<=0) continue;
+    d=fabs(ptr->pwr0[range]-pwr0[range])/p;
+    if (d>*dpwr) *dpwr=d;
+    for (n=range*2*ptr->mplgs;n<(range+1)*2*ptr->mplgs;n++) {
+      d=fabs(ptr->acfd[n]-acfd[n])/p;
+      if (d>*dacf) *dacf=d;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+/* siteacfex.h
+   ===========
+*/
+
+
+#ifndef _SITEACFEX_H
+#define _SITEACFEX_H
+
+struct SiteTimACFex {
+  int nrang;
+  int mplgs;
+  int nave;
+  double *acf;  /* nrang*2*mplgs running sums */
+  int *count;   /* nrang*mplgs pairs added into each sum */
+  float *sort;  /* nrang powers, for the noise estimate */
+  float *pwr0;  /* nrang and nrang*2*mplgs normalised sums, kept */
+  float *acfd;  /* for SiteTimACFexCheck */
+  int acfmax,countmax,sortmax,pwrmax,acfdmax; /* entries allocated */
+};
+
+int SiteTimACFexBegin(struct SiteTimACFex *ptr,int nrang,int mplgs,
+                      int mplgexs,int *lagtable[2]);
+int SiteTimACFexAdd(struct SiteTimACFex *ptr,struct TSGprm *prm,
+                    int16 *inbuf,int insamp,int rngoff,int dflg,
+                    int roffset,int ioffset,int mplgexs,int *lagtable[2]);
+int SiteTimACFexEnd(struct SiteTimACFex *ptr,
+                    float *pwr0,float *acfd,float *noise);
+int SiteTimACFexCheck(struct SiteTimACFex *ptr,
+                      float *pwr0,float *acfd,
+                      double *dpwr,double *dacf,float *noise);
+
+#endif
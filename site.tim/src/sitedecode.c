@@ -0,0 +1,644 @@
+/* sitedecode.c
+   ============
+*/
+/*
+ $License$
+*/
+
+/* Phase code decoding of the interleaved int16 I/Q samples returned by
+ * the ROS. Each output sample n is the sum over the code of the input
+ * samples n+i multiplied by code[i], divided by nbaud with the usual C
+ * truncation and narrowed back to int16. Only the first nsamp-nbaud
+ * samples can be decoded, the remainder are copied across unchanged.
+ * The caller can ask for fewer samples than were received when the
+ * later ones are never used, and can have the output split into
+ * separate I and Q planes rather than interleaved.
+ *
+ * The decode is fused with the phase inversion of the main array and
+ * the copy into the IQ buffer so the received samples are streamed
+ * through once. Inversion is applied to each input sample with the
+ * same wrap around as the old (short) negation, before decoding.
+ *
+ * The vector kernels produce bit-identical results to the scalar loop.
+ * They work on four (SSE2) or eight (AVX2) complex samples at a time and
+ * may be used in place (dst==src), or with dst anywhere below src, as
+ * every load for a block is done before the block is stored. Only the
+ * interleaved output can be made this way, the I and Q planes would
+ * overwrite input not yet read.
+ *
+ * For the Barker codes used by the control programs there is a set of
+ * kernels with the code compiled in. The tap loop is unrolled against a
+ * constant table so each tap becomes a plain add or subtract. The kernel
+ * is picked once by SiteTimDecodeSelect when the sequence is registered;
+ * any other code falls back to the generic multiply kernels. Codes
+ * longer than the FFT threshold go to the overlap-save correlator in
+ * sitefft.c instead.
+ *
+ * When a SiteTimDecodeStat is given the largest I or Q magnitude and
+ * the number of components at or above the clip level are gathered on
+ * the way through, for the sequence screening. Each received sample is
+ * counted once, from the first tap of the decode or from the copy of
+ * the undecoded tail. Magnitudes saturate at 32767, so -32768 counts
+ * as 32767.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rtypes.h"
+#include "sitefft.h"
+#include "sitedecode.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DECODE_X86 1
+#include <immintrin.h>
+#endif
+
+#define DECODE_INLINE static inline __attribute__((always_inline))
+
+/* The vector kernels divide in single precision. The truncated quotient
+ * is exact provided the sum fits in the 24 bit mantissa and the
+ * rounding error of the quotient (at most 2^-9 for |q|<=32768) is
+ * smaller than the 1/nbaud spacing of non-integer quotients. Both hold
+ * for +/-1 codes up to this length; anything else uses the scalar loop.
+ */
+
+#define DECODE_SIMD_MAXBAUD 256
+
+/* Codes with more chips than this are correlated by FFT */
+
+#define DECODE_FFT_THRESHOLD 64
+
+static const int barker2[2]={1,-1};
+static const int barker3[3]={1,1,-1};
+static const int barker4[4]={1,1,-1,1};
+static const int barker5[5]={1,1,1,-1,1};
+static const int barker7[7]={1,1,1,-1,-1,1,-1};
+static const int barker11[11]={1,1,1,-1,-1,-1,1,-1,-1,1,-1};
+static const int barker13[13]={1,1,1,1,1,-1,-1,1,1,-1,1,-1,1};
+
+static int dtype=-1;
+static int fftthr=DECODE_FFT_THRESHOLD;
+
+char *SiteTimDecodeName(int type) {
+  switch (type) {
+    case DECODE_SSE2:
+      return "sse2";
+    case DECODE_AVX2:
+      return "avx2";
+    case DECODE_FFT:
+      return "fft";
+    default:
+      return "scalar";
+  }
+}
+
+DECODE_INLINE void ScreenScalar(struct SiteTimDecodeStat *stat,int16 x) {
+  int m=x;
+  if (m<0) m=-m;
+  if (m>32767) m=32767;
+  if (m>stat->peak) stat->peak=m;
+  if (m>=stat->level) stat->clip++;
+}
+
+static void CopyScalar(int16 *dst,int16 *qdst,int16 *src,int nsamp,int neg,
+                       struct SiteTimDecodeStat *stat) {
+  int n;
+  if (qdst !=NULL) {
+    for (n=0;n<nsamp;n++) {
+      if (stat !=NULL) {
+        ScreenScalar(stat,src[2*n]);
+        ScreenScalar(stat,src[2*n+1]);
+      }
+      dst[n]=(neg) ? (int16) -src[2*n] : src[2*n];
+      qdst[n]=(neg) ? (int16) -src[2*n+1] : src[2*n+1];
+    }
+    return;
+  }
+  if (stat !=NULL) {
+    for (n=0;n<2*nsamp;n++) {
+      ScreenScalar(stat,src[n]);
+      dst[n]=(neg) ? (int16) -src[n] : src[n];
+    }
+    return;
+  }
+  if (neg==0) {
+    if (dst!=src) memmove(dst,src,sizeof(int16)*2*nsamp);
+    return;
+  }
+  for (n=0;n<2*nsamp;n++) dst[n]=(int16) -src[n];
+}
+
+static int DecodeScalar(int16 *dst,int16 *qdst,int16 *src,int nout,int *code,int nbaud,
+                        int neg,struct SiteTimDecodeStat *stat) {
+  int n,i;
+  int Iout,Qout;
+  int16 I,Q;
+  for (n=0;n<nout;n++) {
+    if (stat !=NULL) {
+      ScreenScalar(stat,src[2*n]);
+      ScreenScalar(stat,src[2*n+1]);
+    }
+    Iout=0;
+    Qout=0;
+    for (i=0;i<nbaud;i++) {
+      I=src[2*(n+i)];
+      Q=src[2*(n+i)+1];
+      if (neg) {
+        I=(int16) -I;
+        Q=(int16) -Q;
+      }
+      Iout+=(int) I*code[i];
+      Qout+=(int) Q*code[i];
+    }
+    Iout/=nbaud;
+    Qout/=nbaud;
+    if (qdst==NULL) {
+      dst[2*n]=(int16) Iout;
+      dst[2*n+1]=(int16) Qout;
+    } else {
+      dst[n]=(int16) Iout;
+      qdst[n]=(int16) Qout;
+    }
+  }
+  return n;
+}
+
+/* Fixed code bodies. These are only ever expanded with a constant table
+   and length, which lets the compiler unroll the taps and drop the
+   sign test. */
+
+DECODE_INLINE int DecodeScalarFixed(int16 *dst,int16 *qdst,int16 *src,int nout,
+                                    const int *code,const int nbaud,
+                                    int neg,struct SiteTimDecodeStat *stat) {
+  int n,i;
+  int Iout,Qout;
+  int16 I,Q;
+  for (n=0;n<nout;n++) {
+    if (stat !=NULL) {
+      ScreenScalar(stat,src[2*n]);
+      ScreenScalar(stat,src[2*n+1]);
+    }
+    Iout=0;
+    Qout=0;
+#pragma GCC unroll 16
+    for (i=0;i<nbaud;i++) {
+      I=src[2*(n+i)];
+      Q=src[2*(n+i)+1];
+      if (neg) {
+        I=(int16) -I;
+        Q=(int16) -Q;
+      }
+      if (code[i]>0) {
+        Iout+=I;
+        Qout+=Q;
+      } else {
+        Iout-=I;
+        Qout-=Q;
+      }
+    }
+    Iout/=nbaud;
+    Qout/=nbaud;
+    if (qdst==NULL) {
+      dst[2*n]=(int16) Iout;
+      dst[2*n+1]=(int16) Qout;
+    } else {
+      dst[n]=(int16) Iout;
+      qdst[n]=(int16) Qout;
+    }
+  }
+  return n;
+}
+
+#ifdef DECODE_X86
+
+/* Fold a vector of components into the running peak and clip count,
+   then at the end of a kernel hand them back in the stat */
+
+__attribute__((target("sse2"),always_inline))
+static inline __m128i ScreenSSE2(__m128i x,__m128i lvl,__m128i mx,int *clip) {
+  x=_mm_max_epi16(x,_mm_subs_epi16(_mm_setzero_si128(),x));
+  *clip+=__builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi16(x,lvl)))/2;
+  return _mm_max_epi16(mx,x);
+}
+
+__attribute__((target("sse2"),always_inline))
+static inline void PeakSSE2(struct SiteTimDecodeStat *stat,__m128i mx,
+                            int clip) {
+  int k;
+  int16 buf[8];
+  _mm_storeu_si128((__m128i *) buf,mx);
+  for (k=0;k<8;k++) if (buf[k]>stat->peak) stat->peak=buf[k];
+  stat->clip+=clip;
+}
+
+__attribute__((target("avx2"),always_inline))
+static inline __m256i ScreenAVX2(__m256i x,__m256i lvl,__m256i mx,int *clip) {
+  x=_mm256_max_epi16(x,_mm256_subs_epi16(_mm256_setzero_si256(),x));
+  *clip+=__builtin_popcount(
+           _mm256_movemask_epi8(_mm256_cmpgt_epi16(x,lvl)))/2;
+  return _mm256_max_epi16(mx,x);
+}
+
+__attribute__((target("avx2"),always_inline))
+static inline void PeakAVX2(struct SiteTimDecodeStat *stat,__m256i mx,
+                            int clip) {
+  int k;
+  int16 buf[16];
+  _mm256_storeu_si256((__m256i *) buf,mx);
+  for (k=0;k<16;k++) if (buf[k]>stat->peak) stat->peak=buf[k];
+  stat->clip+=clip;
+}
+
+/* Narrow the decoded I/Q pairs with wrap around, as the (int16) cast
+   does, and store them either interleaved or split into the I and Q
+   planes. */
+
+__attribute__((target("sse2"),always_inline))
+static inline void StoreSSE2(int16 *dst,int16 *qdst,int n,
+                             __m128i lo,__m128i hi) {
+  __m128i iv,qv,p;
+  lo=_mm_srai_epi32(_mm_slli_epi32(lo,16),16);
+  hi=_mm_srai_epi32(_mm_slli_epi32(hi,16),16);
+  if (qdst==NULL) {
+    _mm_storeu_si128((__m128i *) (dst+2*n),_mm_packs_epi32(lo,hi));
+    return;
+  }
+  lo=_mm_shuffle_epi32(lo,_MM_SHUFFLE(3,1,2,0));
+  hi=_mm_shuffle_epi32(hi,_MM_SHUFFLE(3,1,2,0));
+  iv=_mm_unpacklo_epi64(lo,hi);
+  qv=_mm_unpackhi_epi64(lo,hi);
+  p=_mm_packs_epi32(iv,qv);
+  _mm_storel_epi64((__m128i *) (dst+n),p);
+  _mm_storel_epi64((__m128i *) (qdst+n),_mm_srli_si128(p,8));
+}
+
+__attribute__((target("avx2"),always_inline))
+static inline void StoreAVX2(int16 *dst,int16 *qdst,int n,
+                             __m256i lo,__m256i hi) {
+  __m256i iv,qv,p;
+  lo=_mm256_srai_epi32(_mm256_slli_epi32(lo,16),16);
+  hi=_mm256_srai_epi32(_mm256_slli_epi32(hi,16),16);
+  if (qdst==NULL) {
+    _mm256_storeu_si256((__m256i *) (dst+2*n),_mm256_packs_epi32(lo,hi));
+    return;
+  }
+  lo=_mm256_shuffle_epi32(lo,_MM_SHUFFLE(3,1,2,0));
+  hi=_mm256_shuffle_epi32(hi,_MM_SHUFFLE(3,1,2,0));
+  iv=_mm256_unpacklo_epi64(lo,hi);
+  qv=_mm256_unpackhi_epi64(lo,hi);
+  p=_mm256_permute4x64_epi64(_mm256_packs_epi32(iv,qv),_MM_SHUFFLE(3,1,2,0));
+  _mm_storeu_si128((__m128i *) (dst+n),_mm256_castsi256_si128(p));
+  _mm_storeu_si128((__m128i *) (qdst+n),_mm256_extracti128_si256(p,1));
+}
+
+__attribute__((target("sse2")))
+static int CopySSE2(int16 *dst,int16 *src,int nsamp,int neg,
+                    struct SiteTimDecodeStat *stat) {
+  int n;
+  int clip=0;
+  __m128i x;
+  __m128i sgn=_mm_set1_epi16(neg ? -1 : 0);
+  __m128i lvl=_mm_set1_epi16((int16) ((stat !=NULL) ? stat->level-1 : 0));
+  __m128i mx=_mm_setzero_si128();
+  for (n=0;(n+4)<=nsamp;n+=4) {
+    x=_mm_loadu_si128((__m128i *) (src+2*n));
+    if (stat !=NULL) mx=ScreenSSE2(x,lvl,mx,&clip);
+    _mm_storeu_si128((__m128i *) (dst+2*n),
+                     _mm_sub_epi16(_mm_xor_si128(x,sgn),sgn));
+  }
+  if (stat !=NULL) PeakSSE2(stat,mx,clip);
+  return n;
+}
+
+__attribute__((target("sse2")))
+static int DecodeSSE2(int16 *dst,int16 *qdst,int16 *src,int nout,int *code,int nbaud,
+                      int neg,struct SiteTimDecodeStat *stat) {
+  int n,i;
+  int clip=0;
+  __m128i x,c,lo,hi;
+  __m128i zero=_mm_setzero_si128();
+  __m128i sgn=_mm_set1_epi16(neg ? -1 : 0);
+  __m128i lvl=_mm_set1_epi16((int16) ((stat !=NULL) ? stat->level-1 : 0));
+  __m128i mx=_mm_setzero_si128();
+  __m128 div=_mm_set1_ps((float) nbaud);
+
+  for (n=0;(n+4)<=nout;n+=4) {
+    lo=_mm_setzero_si128();
+    hi=_mm_setzero_si128();
+    for (i=0;i<nbaud;i++) {
+      x=_mm_loadu_si128((__m128i *) (src+2*(n+i)));
+      x=_mm_sub_epi16(_mm_xor_si128(x,sgn),sgn);
+      c=_mm_set1_epi16((int16) code[i]);
+      lo=_mm_add_epi32(lo,_mm_madd_epi16(_mm_unpacklo_epi16(x,zero),c));
+      hi=_mm_add_epi32(hi,_mm_madd_epi16(_mm_unpackhi_epi16(x,zero),c));
+    }
+    lo=_mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(lo),div));
+    hi=_mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(hi),div));
+
+    /* the first tap's samples, still in cache and not yet overwritten */
+    if (stat !=NULL)
+      mx=ScreenSSE2(_mm_loadu_si128((__m128i *) (src+2*n)),lvl,mx,&clip);
+    StoreSSE2(dst,qdst,n,lo,hi);
+  }
+  if (stat !=NULL) PeakSSE2(stat,mx,clip);
+  return n;
+}
+
+__attribute__((target("sse2"),always_inline))
+static inline int DecodeSSE2Fixed(int16 *dst,int16 *qdst,int16 *src,int nout,
+                                  const int *code,const int nbaud,int neg,
+                                  struct SiteTimDecodeStat *stat) {
+  int n,i;
+  int clip=0;
+  __m128i x,lo,hi;
+  __m128i sgn=_mm_set1_epi16(neg ? -1 : 0);
+  __m128i lvl=_mm_set1_epi16((int16) ((stat !=NULL) ? stat->level-1 : 0));
+  __m128i mx=_mm_setzero_si128();
+  __m128 div=_mm_set1_ps((float) nbaud);
+
+  for (n=0;(n+4)<=nout;n+=4) {
+    lo=_mm_setzero_si128();
+    hi=_mm_setzero_si128();
+#pragma GCC unroll 16
+    for (i=0;i<nbaud;i++) {
+      x=_mm_loadu_si128((__m128i *) (src+2*(n+i)));
+      x=_mm_sub_epi16(_mm_xor_si128(x,sgn),sgn);
+      if (code[i]>0) {
+        lo=_mm_add_epi32(lo,_mm_srai_epi32(_mm_unpacklo_epi16(x,x),16));
+        hi=_mm_add_epi32(hi,_mm_srai_epi32(_mm_unpackhi_epi16(x,x),16));
+      } else {
+        lo=_mm_sub_epi32(lo,_mm_srai_epi32(_mm_unpacklo_epi16(x,x),16));
+        hi=_mm_sub_epi32(hi,_mm_srai_epi32(_mm_unpackhi_epi16(x,x),16));
+      }
+    }
+    lo=_mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(lo),div));
+    hi=_mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(hi),div));
+    if (stat !=NULL)
+      mx=ScreenSSE2(_mm_loadu_si128((__m128i *) (src+2*n)),lvl,mx,&clip);
+    StoreSSE2(dst,qdst,n,lo,hi);
+  }
+  if (stat !=NULL) PeakSSE2(stat,mx,clip);
+  return n;
+}
+
+__attribute__((target("avx2")))
+static int DecodeAVX2(int16 *dst,int16 *qdst,int16 *src,int nout,int *code,int nbaud,
+                      int neg,struct SiteTimDecodeStat *stat) {
+  int n,i;
+  int clip=0;
+  __m256i x,c,lo,hi;
+  __m256i zero=_mm256_setzero_si256();
+  __m256i sgn=_mm256_set1_epi16(neg ? -1 : 0);
+  __m256i lvl=_mm256_set1_epi16((int16) ((stat !=NULL) ? stat->level-1 : 0));
+  __m256i mx=_mm256_setzero_si256();
+  __m256 div=_mm256_set1_ps((float) nbaud);
+
+  /* unpack and pack both work within 128 bit lanes so the
+     sample order comes back out unchanged */
+
+  for (n=0;(n+8)<=nout;n+=8) {
+    lo=_mm256_setzero_si256();
+    hi=_mm256_setzero_si256();
+    for (i=0;i<nbaud;i++) {
+      x=_mm256_loadu_si256((__m256i *) (src+2*(n+i)));
+      x=_mm256_sub_epi16(_mm256_xor_si256(x,sgn),sgn);
+      c=_mm256_set1_epi16((int16) code[i]);
+      lo=_mm256_add_epi32(lo,_mm256_madd_epi16(_mm256_unpacklo_epi16(x,zero),c));
+      hi=_mm256_add_epi32(hi,_mm256_madd_epi16(_mm256_unpackhi_epi16(x,zero),c));
+    }
+    lo=_mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(lo),div));
+    hi=_mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(hi),div));
+
+    if (stat !=NULL)
+      mx=ScreenAVX2(_mm256_loadu_si256((__m256i *) (src+2*n)),lvl,mx,&clip);
+    StoreAVX2(dst,qdst,n,lo,hi);
+  }
+  if (stat !=NULL) PeakAVX2(stat,mx,clip);
+  return n;
+}
+
+__attribute__((target("avx2"),always_inline))
+static inline int DecodeAVX2Fixed(int16 *dst,int16 *qdst,int16 *src,int nout,
+                                  const int *code,const int nbaud,int neg,
+                                  struct SiteTimDecodeStat *stat) {
+  int n,i;
+  int clip=0;
+  __m256i x,lo,hi;
+  __m256i sgn=_mm256_set1_epi16(neg ? -1 : 0);
+  __m256i lvl=_mm256_set1_epi16((int16) ((stat !=NULL) ? stat->level-1 : 0));
+  __m256i mx=_mm256_setzero_si256();
+  __m256 div=_mm256_set1_ps((float) nbaud);
+
+  for (n=0;(n+8)<=nout;n+=8) {
+    lo=_mm256_setzero_si256();
+    hi=_mm256_setzero_si256();
+#pragma GCC unroll 16
+    for (i=0;i<nbaud;i++) {
+      x=_mm256_loadu_si256((__m256i *) (src+2*(n+i)));
+      x=_mm256_sub_epi16(_mm256_xor_si256(x,sgn),sgn);
+      if (code[i]>0) {
+        lo=_mm256_add_epi32(lo,_mm256_srai_epi32(_mm256_unpacklo_epi16(x,x),16));
+        hi=_mm256_add_epi32(hi,_mm256_srai_epi32(_mm256_unpackhi_epi16(x,x),16));
+      } else {
+        lo=_mm256_sub_epi32(lo,_mm256_srai_epi32(_mm256_unpacklo_epi16(x,x),16));
+        hi=_mm256_sub_epi32(hi,_mm256_srai_epi32(_mm256_unpackhi_epi16(x,x),16));
+      }
+    }
+    lo=_mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(lo),div));
+    hi=_mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(hi),div));
+    if (stat !=NULL)
+      mx=ScreenAVX2(_mm256_loadu_si256((__m256i *) (src+2*n)),lvl,mx,&clip);
+    StoreAVX2(dst,qdst,n,lo,hi);
+  }
+  if (stat !=NULL) PeakAVX2(stat,mx,clip);
+  return n;
+}
+
+#endif
+
+/* One set of kernels per built in code. The code and nbaud arguments
+   are ignored; they are there to share the generic kernel signature. */
+
+#ifdef DECODE_X86
+#define DECODE_FIXED(L) \
+static int DecodeScalar##L(int16 *dst,int16 *qdst,int16 *src,int nout, \
+                           int *code,int nbaud,int neg, \
+                           struct SiteTimDecodeStat *stat) { \
+  (void) code; (void) nbaud; \
+  return DecodeScalarFixed(dst,qdst,src,nout,barker##L,L,neg,stat); \
+} \
+__attribute__((target("sse2"))) \
+static int DecodeSSE2##L(int16 *dst,int16 *qdst,int16 *src,int nout, \
+                         int *code,int nbaud,int neg, \
+                         struct SiteTimDecodeStat *stat) { \
+  (void) code; (void) nbaud; \
+  return DecodeSSE2Fixed(dst,qdst,src,nout,barker##L,L,neg,stat); \
+} \
+__attribute__((target("avx2"))) \
+static int DecodeAVX2##L(int16 *dst,int16 *qdst,int16 *src,int nout, \
+                         int *code,int nbaud,int neg, \
+                         struct SiteTimDecodeStat *stat) { \
+  (void) code; (void) nbaud; \
+  return DecodeAVX2Fixed(dst,qdst,src,nout,barker##L,L,neg,stat); \
+}
+#define DECODE_ENTRY(L) \
+  {L,barker##L,{DecodeScalar##L,DecodeSSE2##L,DecodeAVX2##L}}
+#else
+#define DECODE_FIXED(L) \
+static int DecodeScalar##L(int16 *dst,int16 *qdst,int16 *src,int nout, \
+                           int *code,int nbaud,int neg, \
+                           struct SiteTimDecodeStat *stat) { \
+  (void) code; (void) nbaud; \
+  return DecodeScalarFixed(dst,qdst,src,nout,barker##L,L,neg,stat); \
+}
+#define DECODE_ENTRY(L) \
+  {L,barker##L,{DecodeScalar##L,NULL,NULL}}
+#endif
+
+DECODE_FIXED(2)
+DECODE_FIXED(3)
+DECODE_FIXED(4)
+DECODE_FIXED(5)
+DECODE_FIXED(7)
+DECODE_FIXED(11)
+DECODE_FIXED(13)
+
+struct DecodeFixed {
+  int nbaud;
+  const int *code;
+  SiteTimDecodeKernel kernel[3]; /* indexed by DECODE_SCALAR etc */
+};
+
+static struct DecodeFixed fixed[]={
+  DECODE_ENTRY(2),
+  DECODE_ENTRY(3),
+  DECODE_ENTRY(4),
+  DECODE_ENTRY(5),
+  DECODE_ENTRY(7),
+  DECODE_ENTRY(11),
+  DECODE_ENTRY(13),
+  {0,NULL,{NULL,NULL,NULL}}
+};
+
+int SiteTimDecodeInit() {
+  dtype=DECODE_SCALAR;
+#ifdef DECODE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) dtype=DECODE_SSE2;
+  if (__builtin_cpu_supports("avx2")) dtype=DECODE_AVX2;
+#endif
+  return dtype;
+}
+
+void SiteTimDecodeFFTThreshold(int nbaud) {
+  fftthr=nbaud;
+}
+
+int SiteTimDecodeSelect(struct SiteTimDecoder *ptr,int *code,int nbaud) {
+  int i,j;
+  int pm=1;
+  double *cre=NULL;
+
+  if (ptr==NULL) return -1;
+  if (dtype==-1) SiteTimDecodeInit();
+
+  if (ptr->pc !=NULL) SiteTimPCFree(ptr->pc);
+  memset(ptr,0,sizeof(struct SiteTimDecoder));
+  ptr->nbaud=nbaud;
+  ptr->code=code;
+  ptr->type=DECODE_SCALAR;
+  ptr->vector=1;
+
+  /* an uncoded pulse is only ever copied */
+  if ((nbaud<=1) || (code==NULL)) return 0;
+
+  for (j=0;fixed[j].nbaud !=0;j++) {
+    if (fixed[j].nbaud !=nbaud) continue;
+    for (i=0;i<nbaud;i++) if (code[i] !=fixed[j].code[i]) break;
+    if (i<nbaud) continue;
+    ptr->fixed=nbaud;
+    ptr->skernel=fixed[j].kernel[DECODE_SCALAR];
+    if ((dtype !=DECODE_SCALAR) && (fixed[j].kernel[dtype] !=NULL)) {
+      ptr->type=dtype;
+      ptr->vkernel=fixed[j].kernel[dtype];
+      ptr->vector=(dtype==DECODE_AVX2) ? 8 : 4;
+    }
+    return 0;
+  }
+
+  ptr->skernel=DecodeScalar;
+
+  if ((fftthr>0) && (nbaud>fftthr)) {
+    cre=malloc(sizeof(double)*nbaud);
+    if (cre !=NULL) {
+      for (i=0;i<nbaud;i++) cre[i]=code[i];
+      ptr->pc=SiteTimPCMake(cre,NULL,nbaud);
+      free(cre);
+    }
+    if (ptr->pc !=NULL) {
+      ptr->type=DECODE_FFT;
+      return 0;
+    }
+    fprintf(stderr,"SiteTimDecodeSelect: no FFT plan, using direct decode\n");
+  }
+
+  if (nbaud>DECODE_SIMD_MAXBAUD) pm=0;
+  for (i=0;i<nbaud;i++) if ((code[i]!=1) && (code[i]!=-1)) pm=0;
+
+#ifdef DECODE_X86
+  if (pm) {
+    if (dtype==DECODE_AVX2) {
+      ptr->type=DECODE_AVX2;
+      ptr->vkernel=DecodeAVX2;
+      ptr->vector=8;
+    } else if (dtype==DECODE_SSE2) {
+      ptr->type=DECODE_SSE2;
+      ptr->vkernel=DecodeSSE2;
+      ptr->vector=4;
+    }
+  }
+#endif
+  return 0;
+}
+
+int SiteTimDecodeCopy(struct SiteTimDecoder *ptr,int16 *dst,int16 *qdst,
+                      int16 *src,int nsamp,int nuse,int neg,
+                      struct SiteTimDecodeStat *stat) {
+  int n=0;
+  int nout=0;
+  int step=(qdst==NULL) ? 2 : 1;
+
+  /* nsamp samples are available, the first nuse are wanted. With a
+     Q plane given the output is split into dst (I) and qdst (Q). */
+
+  if (nuse>nsamp) nuse=nsamp;
+  if (nuse<=0) return 0;
+  if (stat !=NULL) {
+    if (stat->level<1) stat->level=1;
+    if (stat->level>32767) stat->level=32767;
+  }
+  if (ptr->skernel !=NULL) nout=nsamp-ptr->nbaud;
+  if (nout>nuse) nout=nuse;
+  if (nout<0) nout=0;
+
+  if ((nout>0) && (ptr->pc !=NULL))
+    n=SiteTimPCDecode(ptr->pc,dst,qdst,src,nsamp,nout,neg,stat);
+  else if ((nout>0) && (ptr->vkernel !=NULL))
+    n=(ptr->vkernel)(dst,qdst,src,nout,ptr->code,ptr->nbaud,neg,stat);
+
+  /* finish off the samples that do not fill a vector */
+  if (nout>n)
+    (ptr->skernel)(dst+step*n,(qdst==NULL) ? NULL : qdst+n,src+2*n,
+                   nout-n,ptr->code,ptr->nbaud,neg,stat);
+
+  /* the undecoded tail, or everything for an uncoded pulse */
+  n=nout;
+#ifdef DECODE_X86
+  if (((neg) || (stat !=NULL)) && (qdst==NULL) && (dtype!=DECODE_SCALAR)) 
+    n+=CopySSE2(dst+2*n,src+2*n,nuse-n,neg,stat);
+#endif
+  CopyScalar(dst+step*n,(qdst==NULL) ? NULL : qdst+n,src+2*n,nuse-n,neg,
+             stat);
+  return nout;
+}
@@ -0,0 +1,47 @@
+/* sitedecode.h
+   ============
+*/
+
+
+#ifndef _SITEDECODE_H
+#define _SITEDECODE_H
+
+#define DECODE_SCALAR 0
+#define DECODE_SSE2 1
+#define DECODE_AVX2 2
+#define DECODE_FFT 3
+
+struct SiteTimPCPlan;
+
+/* saturation statistics gathered as the samples are read */
+
+struct SiteTimDecodeStat {
+  int level;  /* I or Q magnitude counted as clipped */
+  int peak;   /* largest I or Q magnitude */
+  int clip;   /* I and Q components at or above level */
+};
+
+typedef int (*SiteTimDecodeKernel)(int16 *dst,int16 *qdst,int16 *src,int nout,
+                                   int *code,int nbaud,int neg,
+                                   struct SiteTimDecodeStat *stat);
+
+struct SiteTimDecoder {
+  int nbaud;
+  int *code;
+  int type;
+  int fixed;      /* length of the built in code the kernel is fixed to */
+  int vector;     /* number of samples handled per vector step */
+  SiteTimDecodeKernel vkernel;
+  SiteTimDecodeKernel skernel;
+  struct SiteTimPCPlan *pc; /* FFT correlator for long codes */
+};
+
+int SiteTimDecodeInit();
+char *SiteTimDecodeName(int type);
+void SiteTimDecodeFFTThreshold(int nbaud);
+int SiteTimDecodeSelect(struct SiteTimDecoder *ptr,int *code,int nbaud);
+int SiteTimDecodeCopy(struct SiteTimDecoder *ptr,int16 *dst,int16 *qdst,
+                      int16 *src,int nsamp,int nuse,int neg,
+                      struct SiteTimDecodeStat *stat);
+
+#endif
@@ -0,0 +1,236 @@
+/* sitefft.c
+   =========
+*/
+/*
+ $License$
+*/
+
+/* FFT pulse compression for long phase codes.
+ *
+ * The direct decode costs nbaud operations per sample, which is fine for
+ * the Barker codes but not for the long concatenated or polyphase codes.
+ * Above a threshold the decoder hands the samples to an overlap-save
+ * correlator instead. Each FFT of length n yields n-nbaud+1 outputs
+ *
+ *    y[k] = sum_i x[k+i] * conj(c[i])
+ *
+ * which for a real code is exactly the sum formed by the direct decoder.
+ * The sum is rounded to the nearest integer, divided by nbaud with C
+ * truncation and narrowed to int16 so the output format matches the
+ * direct path. For integer codes the rounding error of the transform is
+ * many orders of magnitude below 0.5 and the result is identical.
+ *
+ * The plan, the twiddles and the code spectrum are all built once when
+ * the sequence is registered. The screening statistics are taken from
+ * the first block samples of each span as they are loaded, since the
+ * rest of the span is loaded again by the next block.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rtypes.h"
+#include "sitefft.h"
+#include "sitedecode.h"
+
+struct SiteTimFFT *SiteTimFFTMake(int n) {
+  int i,j,b;
+  struct SiteTimFFT *ptr=NULL;
+
+  if ((n<2) || (n & (n-1))) return NULL;
+
+  ptr=malloc(sizeof(struct SiteTimFFT));
+  if (ptr==NULL) return NULL;
+  ptr->n=n;
+  ptr->bitrev=malloc(sizeof(int)*n);
+  ptr->cos=malloc(sizeof(double)*n/2);
+  ptr->sin=malloc(sizeof(double)*n/2);
+  if ((ptr->bitrev==NULL) || (ptr->cos==NULL) || (ptr->sin==NULL)) {
+    SiteTimFFTFree(ptr);
+    return NULL;
+  }
+
+  for (b=0;(1<<b)<n;b++);
+  for (i=0;i<n;i++) {
+    ptr->bitrev[i]=0;
+    for (j=0;j<b;j++) if (i & (1<<j)) ptr->bitrev[i]|=1<<(b-1-j);
+  }
+  for (i=0;i<n/2;i++) {
+    ptr->cos[i]=cos(2*M_PI*i/n);
+    ptr->sin[i]=-sin(2*M_PI*i/n);
+  }
+  return ptr;
+}
+
+void SiteTimFFTFree(struct SiteTimFFT *ptr) {
+  if (ptr==NULL) return;
+  if (ptr->bitrev !=NULL) free(ptr->bitrev);
+  if (ptr->cos !=NULL) free(ptr->cos);
+  if (ptr->sin !=NULL) free(ptr->sin);
+  free(ptr);
+}
+
+/* In place iterative radix-2 transform. The inverse is not scaled. */
+
+void SiteTimFFTCalc(struct SiteTimFFT *ptr,double *re,double *im,int inverse) {
+  int i,j,k,m,h,step;
+  int n=ptr->n;
+  double wr,wi,tr,ti;
+  double sgn=(inverse) ? -1.0 : 1.0;
+
+  for (i=0;i<n;i++) {
+    j=ptr->bitrev[i];
+    if (j>i) {
+      tr=re[i];
+      re[i]=re[j];
+      re[j]=tr;
+      ti=im[i];
+      im[i]=im[j];
+      im[j]=ti;
+    }
+  }
+
+  for (m=2;m<=n;m*=2) {
+    h=m/2;
+    step=n/m;
+    for (k=0;k<n;k+=m) {
+      for (j=0;j<h;j++) {
+        wr=ptr->cos[j*step];
+        wi=sgn*ptr->sin[j*step];
+        tr=wr*re[k+j+h]-wi*im[k+j+h];
+        ti=wr*im[k+j+h]+wi*re[k+j+h];
+        re[k+j+h]=re[k+j]-tr;
+        im[k+j+h]=im[k+j]-ti;
+        re[k+j]+=tr;
+        im[k+j]+=ti;
+      }
+    }
+  }
+}
+
+void SiteTimPCFree(struct SiteTimPCPlan *ptr) {
+  if (ptr==NULL) return;
+  if (ptr->fft !=NULL) SiteTimFFTFree(ptr->fft);
+  if (ptr->cre !=NULL) free(ptr->cre);
+  if (ptr->cim !=NULL) free(ptr->cim);
+  if (ptr->xre !=NULL) free(ptr->xre);
+  if (ptr->xim !=NULL) free(ptr->xim);
+  free(ptr);
+}
+
+struct SiteTimPCPlan *SiteTimPCMake(double *cre,double *cim,int nbaud) {
+  int i,n;
+  struct SiteTimPCPlan *ptr=NULL;
+
+  if (nbaud<1) return NULL;
+
+  /* four times the code length keeps the wasted overlap to a quarter */
+  for (n=64;n<4*nbaud;n*=2);
+
+  ptr=malloc(sizeof(struct SiteTimPCPlan));
+  if (ptr==NULL) return NULL;
+  memset(ptr,0,sizeof(struct SiteTimPCPlan));
+  ptr->nbaud=nbaud;
+  ptr->block=n-nbaud+1;
+  ptr->fft=SiteTimFFTMake(n);
+  ptr->cre=malloc(sizeof(double)*n);
+  ptr->cim=malloc(sizeof(double)*n);
+  ptr->xre=malloc(sizeof(double)*n);
+  ptr->xim=malloc(sizeof(double)*n);
+  if ((ptr->fft==NULL) || (ptr->cre==NULL) || (ptr->cim==NULL) ||
+      (ptr->xre==NULL) || (ptr->xim==NULL)) {
+    SiteTimPCFree(ptr);
+    return NULL;
+  }
+
+  for (i=0;i<n;i++) {
+    ptr->cre[i]=0;
+    ptr->cim[i]=0;
+  }
+  for (i=0;i<nbaud;i++) {
+    ptr->cre[i]=cre[i];
+    if (cim !=NULL) ptr->cim[i]=cim[i];
+  }
+  SiteTimFFTCalc(ptr->fft,ptr->cre,ptr->cim,0);
+
+  /* correlation: multiply by the conjugate, and fold in the 1/n of
+     the inverse transform */
+  for (i=0;i<n;i++) {
+    ptr->cre[i]=ptr->cre[i]/n;
+    ptr->cim[i]=-ptr->cim[i]/n;
+  }
+  return ptr;
+}
+
+int SiteTimPCDecode(struct SiteTimPCPlan *ptr,int16 *dst,int16 *qdst,
+                    int16 *src,int nsamp,int nout,int neg,
+                    struct SiteTimDecodeStat *stat) {
+  int i,k,s,len,use,m;
+  int n=ptr->fft->n;
+  int nbaud=ptr->nbaud;
+  double *xre=ptr->xre,*xim=ptr->xim;
+  double tr,ti;
+  int16 I,Q;
+  int Iout,Qout;
+
+  /* every block reads its whole input span before any of its
+     output is written, so this is safe in place */
+
+  for (s=0;s<nout;s+=ptr->block) {
+    len=n;
+    if ((s+len)>nsamp) len=nsamp-s;
+    use=(stat !=NULL) ? ptr->block : 0;
+    if ((s+use)>nout) use=nout-s;
+    for (i=0;i<len;i++) {
+      I=src[2*(s+i)];
+      Q=src[2*(s+i)+1];
+      if (i<use) {
+        m=(I<0) ? -I : I;
+        if (m>32767) m=32767;
+        if (m>stat->peak) stat->peak=m;
+        if (m>=stat->level) stat->clip++;
+        m=(Q<0) ? -Q : Q;
+        if (m>32767) m=32767;
+        if (m>stat->peak) stat->peak=m;
+        if (m>=stat->level) stat->clip++;
+      }
+      if (neg) {
+        I=(int16) -I;
+        Q=(int16) -Q;
+      }
+      xre[i]=I;
+      xim[i]=Q;
+    }
+    for (i=len;i<n;i++) {
+      xre[i]=0;
+      xim[i]=0;
+    }
+
+    SiteTimFFTCalc(ptr->fft,xre,xim,0);
+    for (i=0;i<n;i++) {
+      tr=xre[i]*ptr->cre[i]-xim[i]*ptr->cim[i];
+      ti=xre[i]*ptr->cim[i]+xim[i]*ptr->cre[i];
+      xre[i]=tr;
+      xim[i]=ti;
+    }
+    SiteTimFFTCalc(ptr->fft,xre,xim,1);
+
+    len=ptr->block;
+    if ((s+len)>nout) len=nout-s;
+    for (k=0;k<len;k++) {
+      Iout=(int) floor(xre[k]+0.5);
+      Qout=(int) floor(xim[k]+0.5);
+      Iout/=nbaud;
+      Qout/=nbaud;
+      if (qdst==NULL) {
+        dst[2*(s+k)]=(int16) Iout;
+        dst[2*(s+k)+1]=(int16) Qout;
+      } else {
+        dst[s+k]=(int16) Iout;
+        qdst[s+k]=(int16) Qout;
+      }
+    }
+  }
+  return nout;
+}
@@ -0,0 +1,36 @@
+/* sitefft.h
+   =========
+*/
+
+
+#ifndef _SITEFFT_H
+#define _SITEFFT_H
+
+struct SiteTimFFT {
+  int n;
+  int *bitrev;
+  double *cos;
+  double *sin;
+};
+
+struct SiteTimPCPlan {
+  int nbaud;
+  int block;          /* output samples produced per FFT */
+  struct SiteTimFFT *fft;
+  double *cre,*cim;   /* conjugate spectrum of the code */
+  double *xre,*xim;   /* work buffers */
+};
+
+struct SiteTimDecodeStat;
+
+struct SiteTimFFT *SiteTimFFTMake(int n);
+void SiteTimFFTFree(struct SiteTimFFT *ptr);
+void SiteTimFFTCalc(struct SiteTimFFT *ptr,double *re,double *im,int inverse);
+
+struct SiteTimPCPlan *SiteTimPCMake(double *cre,double *cim,int nbaud);
+void SiteTimPCFree(struct SiteTimPCPlan *ptr);
+int SiteTimPCDecode(struct SiteTimPCPlan *ptr,int16 *dst,int16 *qdst,
+                    int16 *src,int nsamp,int nout,int neg,
+                    struct SiteTimDecodeStat *stat);
+
+#endif
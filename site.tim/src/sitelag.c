@@ -0,0 +1,780 @@
+/* sitelag.c
+   =========
+*/
+/*
+ $License$
+*/
+
+/* Fused lag-0 power, ACF and XCF accumulation for one sequence.
+ *
+ * This does the work of ACFSumPower, ACFCalculate(ACF_PART) and
+ * ACFCalculate(XCF_PART) in a single sweep over the samples. For each
+ * range and lag the first main sample and the second main and back
+ * samples are loaded once and shared by the three products; the lag-0
+ * power is the square of the first sample of lag 0. The sweep is done
+ * lag by lag so that a run of range gates can be handled together.
+ *
+ * The arithmetic is done in single precision in the same order as the
+ * library routines, so the accumulators come out bit-identical. Sample
+ * addressing follows ACFCalculate: sample (pos*(mpinc/smsep)+range+
+ * smdelay)*rngoff, with the alternate lag-0 pulse pair at mplgs used
+ * for ranges at or beyond badrange. The back samples are xcfoff int16
+ * on from the main ones.
+ *
+ * Consecutive range gates are consecutive samples, so the vector
+ * kernels take four (SSE2) or eight (AVX2) gates of one lag at a time.
+ * The int16 component products are formed exactly in int32. Converting
+ * an exact product to single precision rounds it the same way the
+ * library's float multiply does, so the sums, differences and divisions
+ * that follow give the same result as the scalar loop. Both the
+ * interleaved layout (rngoff 2, Q one on from I) and the planar layout
+ * (rngoff 1) are handled; anything else uses the scalar loop.
+ *
+ * pwr0 or xcfbuf may be NULL to skip that product.
+ *
+ * The integration sums into a SiteTimLagAcc laid out for the active
+ * sequence: nrang powers and nrang x mplgs complex ACF and XCF values,
+ * each block starting on a cache line. It is only rebuilt when the
+ * sequence is registered, and copied out to the global arrays once at
+ * the end of the integration.
+ *
+ * While the attenuation stays the same the accumulator sums the int32
+ * component products in 64 bit integers, which is exact, and divides
+ * by the attenuation once when the sums are converted to floats at the
+ * end. If the attenuation changes part way through, the integer sums
+ * are converted there and the rest of the integration is summed in
+ * floats, per product, as before.
+ *
+ * An integration with one lag, no XCF and lag-0 pulse pairs that each
+ * use a single pulse (the power-only scans) needs nothing but the
+ * power: the lag-0 ACF of a pulse with itself is the power, with no
+ * imaginary part. Only the power is summed and the ACF is filled in
+ * from it when the sums are converted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rtypes.h"
+#include "tsg.h"
+#include "sitelag.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LAG_X86 1
+#include <immintrin.h>
+#endif
+
+#define LAG_ALIGN 64
+
+#define LAG_SCALAR 0
+#define LAG_SSE2 1
+#define LAG_AVX2 2
+
+static int ltype=-1;
+
+char *SiteTimLagName(int type) {
+  switch (type) {
+    case LAG_SSE2:
+      return "sse2";
+    case LAG_AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+int SiteTimLagInit() {
+  ltype=LAG_SCALAR;
+#ifdef LAG_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) ltype=LAG_SSE2;
+  if (__builtin_cpu_supports("avx2")) ltype=LAG_AVX2;
+#endif
+  return ltype;
+}
+
+/* One lag for ranges [0,nrng). p1 points at the I component of the
+   first sample for the first range, p2 and pb at the second main and
+   back samples, qoff is the offset from I to Q. pwr, acf and xcf are
+   the accumulators for the first range; the ACF and XCF have the
+   imaginary part next to the real part and successive ranges stride
+   apart. pwr and xcf may be NULL. */
+
+static void LagScalar(int16 *p1,int16 *p2,int16 *pb,int rngoff,int qoff,
+                      int nrng,float atten,float *pwr,float *acf,float *xcf,
+                      int stride) {
+  int n;
+  float r1,i1,r2,i2;
+  float temp1,temp2;
+  float real,imag,pwr0;
+
+  for (n=0;n<nrng;n++) {
+    r1=p1[n*rngoff];
+    i1=p1[n*rngoff+qoff];
+    if (pwr !=NULL) {
+      pwr0=r1*r1+i1*i1;
+      if (atten !=0) pwr0=pwr0/atten;
+      pwr[n]=pwr0+pwr[n];
+    }
+
+    r2=p2[n*rngoff];
+    i2=p2[n*rngoff+qoff];
+    temp1=r1*r2;
+    temp2=i1*i2;
+    real=temp1+temp2;
+    temp1=r1*i2;
+    temp2=r2*i1;
+    imag=temp1-temp2;
+    if (atten !=0) {
+      real=real/atten;
+      imag=imag/atten;
+    }
+    acf[n*stride]=real+acf[n*stride];
+    acf[n*stride+1]=imag+acf[n*stride+1];
+
+    if (xcf==NULL) continue;
+    r2=pb[n*rngoff];
+    i2=pb[n*rngoff+qoff];
+    temp1=r1*r2;
+    temp2=i1*i2;
+    real=temp1+temp2;
+    temp1=r1*i2;
+    temp2=r2*i1;
+    imag=temp1-temp2;
+    if (atten !=0) {
+      real=real/atten;
+      imag=imag/atten;
+    }
+    xcf[n*stride]=real+xcf[n*stride];
+    xcf[n*stride+1]=imag+xcf[n*stride+1];
+  }
+}
+
+/* As LagScalar but summing the exact integer products. */
+
+static void LagScalarExact(int16 *p1,int16 *p2,int16 *pb,int rngoff,int qoff,
+                           int nrng,int64_t *pwr,int64_t *acf,int64_t *xcf,
+                           int stride) {
+  int n;
+  int32 r1,i1,r2,i2;
+
+  for (n=0;n<nrng;n++) {
+    r1=p1[n*rngoff];
+    i1=p1[n*rngoff+qoff];
+    if (pwr !=NULL) pwr[n]+=(int64_t) r1*r1+(int64_t) i1*i1;
+
+    r2=p2[n*rngoff];
+    i2=p2[n*rngoff+qoff];
+    acf[n*stride]+=(int64_t) r1*r2+(int64_t) i1*i2;
+    acf[n*stride+1]+=(int64_t) r1*i2-(int64_t) r2*i1;
+
+    if (xcf==NULL) continue;
+    r2=pb[n*rngoff];
+    i2=pb[n*rngoff+qoff];
+    xcf[n*stride]+=(int64_t) r1*r2+(int64_t) i1*i2;
+    xcf[n*stride+1]+=(int64_t) r1*i2-(int64_t) r2*i1;
+  }
+}
+
+/* Lag-0 power alone. This is a plain loop the compiler can vectorize. */
+
+static void LagPowerExact(int16 *p1,int rngoff,int qoff,int nrng,
+                          int64_t *pwr) {
+  int n;
+  int32 r1,i1;
+
+  for (n=0;n<nrng;n++) {
+    r1=p1[n*rngoff];
+    i1=p1[n*rngoff+qoff];
+    pwr[n]+=r1*r1+(int64_t) i1*i1;
+  }
+}
+
+#ifdef LAG_X86
+
+/* The vector kernels hold each sample as a 32 bit I/Q word and form
+   the four component products with pmaddwd against a masked copy of
+   the other sample, swapping its I and Q for the cross terms. */
+
+__attribute__((target("sse2"),always_inline))
+static inline __m128i LoadSSE2(int16 *p,int qoff,int planar) {
+  if (planar) return _mm_unpacklo_epi16(_mm_loadl_epi64((__m128i *) p),
+                                        _mm_loadl_epi64((__m128i *) (p+qoff)));
+  return _mm_loadu_si128((__m128i *) p);
+}
+
+/* The four int32 component products r1*r2, i1*i2, r1*i2 and r2*i1 */
+
+__attribute__((target("sse2"),always_inline))
+static inline void TermsSSE2(__m128i a,__m128i b,__m128i *t) {
+  __m128i lo=_mm_set1_epi32(0x0000ffff);
+  __m128i hi=_mm_set1_epi32((int) 0xffff0000);
+  __m128i s=_mm_or_si128(_mm_slli_epi32(b,16),_mm_srli_epi32(b,16));
+  t[0]=_mm_madd_epi16(a,_mm_and_si128(b,lo));
+  t[1]=_mm_madd_epi16(a,_mm_and_si128(b,hi));
+  t[2]=_mm_madd_epi16(a,_mm_and_si128(s,lo));
+  t[3]=_mm_madd_epi16(a,_mm_and_si128(s,hi));
+}
+
+__attribute__((target("sse2"),always_inline))
+static inline void ProductSSE2(__m128i a,__m128i b,float atten,
+                               __m128 *real,__m128 *imag) {
+  __m128i t[4];
+  TermsSSE2(a,b,t);
+  *real=_mm_add_ps(_mm_cvtepi32_ps(t[0]),_mm_cvtepi32_ps(t[1]));
+  *imag=_mm_sub_ps(_mm_cvtepi32_ps(t[2]),_mm_cvtepi32_ps(t[3]));
+  if (atten !=0) {
+    *real=_mm_div_ps(*real,_mm_set1_ps(atten));
+    *imag=_mm_div_ps(*imag,_mm_set1_ps(atten));
+  }
+}
+
+__attribute__((target("sse2"),always_inline))
+static inline void AddSSE2(float *acc,int stride,__m128 real,__m128 imag) {
+  int k;
+  float rbuf[4],ibuf[4];
+  _mm_storeu_ps(rbuf,real);
+  _mm_storeu_ps(ibuf,imag);
+  for (k=0;k<4;k++) {
+    acc[k*stride]=rbuf[k]+acc[k*stride];
+    acc[k*stride+1]=ibuf[k]+acc[k*stride+1];
+  }
+}
+
+__attribute__((target("sse2")))
+static int LagSSE2(int16 *p1,int16 *p2,int16 *pb,int rngoff,int qoff,
+                   int nrng,float atten,float *pwr,float *acf,float *xcf,
+                   int stride) {
+  int n,k;
+  int planar=(rngoff==1);
+  __m128i a;
+  __m128 real,imag;
+  float rbuf[4];
+
+  for (n=0;(n+4)<=nrng;n+=4) {
+    a=LoadSSE2(p1+n*rngoff,qoff,planar);
+    if (pwr !=NULL) {
+      ProductSSE2(a,a,atten,&real,&imag);
+      _mm_storeu_ps(rbuf,real);
+      for (k=0;k<4;k++) pwr[n+k]=rbuf[k]+pwr[n+k];
+    }
+    ProductSSE2(a,LoadSSE2(p2+n*rngoff,qoff,planar),atten,&real,&imag);
+    AddSSE2(acf+n*stride,stride,real,imag);
+    if (xcf==NULL) continue;
+    ProductSSE2(a,LoadSSE2(pb+n*rngoff,qoff,planar),atten,&real,&imag);
+    AddSSE2(xcf+n*stride,stride,real,imag);
+  }
+  return n;
+}
+
+__attribute__((target("sse2"),always_inline))
+static inline void AddExactSSE2(int64_t *acc,int stride,__m128i *t) {
+  int k;
+  int32 tbuf[4][4];
+  for (k=0;k<4;k++) _mm_storeu_si128((__m128i *) tbuf[k],t[k]);
+  for (k=0;k<4;k++) {
+    acc[k*stride]+=(int64_t) tbuf[0][k]+tbuf[1][k];
+    acc[k*stride+1]+=(int64_t) tbuf[2][k]-tbuf[3][k];
+  }
+}
+
+__attribute__((target("sse2")))
+static int LagExactSSE2(int16 *p1,int16 *p2,int16 *pb,int rngoff,int qoff,
+                        int nrng,int64_t *pwr,int64_t *acf,int64_t *xcf,
+                        int stride) {
+  int n,k;
+  int planar=(rngoff==1);
+  __m128i a,t[4];
+  int32 tbuf[2][4];
+
+  for (n=0;(n+4)<=nrng;n+=4) {
+    a=LoadSSE2(p1+n*rngoff,qoff,planar);
+    if (pwr !=NULL) {
+      TermsSSE2(a,a,t);
+      _mm_storeu_si128((__m128i *) tbuf[0],t[0]);
+      _mm_storeu_si128((__m128i *) tbuf[1],t[1]);
+      for (k=0;k<4;k++) pwr[n+k]+=(int64_t) tbuf[0][k]+tbuf[1][k];
+    }
+    TermsSSE2(a,LoadSSE2(p2+n*rngoff,qoff,planar),t);
+    AddExactSSE2(acf+n*stride,stride,t);
+    if (xcf==NULL) continue;
+    TermsSSE2(a,LoadSSE2(pb+n*rngoff,qoff,planar),t);
+    AddExactSSE2(xcf+n*stride,stride,t);
+  }
+  return n;
+}
+
+__attribute__((target("avx2"),always_inline))
+static inline __m256i LoadAVX2(int16 *p,int qoff,int planar) {
+  __m128i vi,vq;
+  if (planar) {
+    vi=_mm_loadu_si128((__m128i *) p);
+    vq=_mm_loadu_si128((__m128i *) (p+qoff));
+    return _mm256_inserti128_si256(
+             _mm256_castsi128_si256(_mm_unpacklo_epi16(vi,vq)),
+             _mm_unpackhi_epi16(vi,vq),1);
+  }
+  return _mm256_loadu_si256((__m256i *) p);
+}
+
+__attribute__((target("avx2"),always_inline))
+static inline void TermsAVX2(__m256i a,__m256i b,__m256i *t) {
+  __m256i lo=_mm256_set1_epi32(0x0000ffff);
+  __m256i hi=_mm256_set1_epi32((int) 0xffff0000);
+  __m256i s=_mm256_or_si256(_mm256_slli_epi32(b,16),_mm256_srli_epi32(b,16));
+  t[0]=_mm256_madd_epi16(a,_mm256_and_si256(b,lo));
+  t[1]=_mm256_madd_epi16(a,_mm256_and_si256(b,hi));
+  t[2]=_mm256_madd_epi16(a,_mm256_and_si256(s,lo));
+  t[3]=_mm256_madd_epi16(a,_mm256_and_si256(s,hi));
+}
+
+__attribute__((target("avx2"),always_inline))
+static inline void ProductAVX2(__m256i a,__m256i b,float atten,
+                               __m256 *real,__m256 *imag) {
+  __m256i t[4];
+  TermsAVX2(a,b,t);
+  *real=_mm256_add_ps(_mm256_cvtepi32_ps(t[0]),_mm256_cvtepi32_ps(t[1]));
+  *imag=_mm256_sub_ps(_mm256_cvtepi32_ps(t[2]),_mm256_cvtepi32_ps(t[3]));
+  if (atten !=0) {
+    *real=_mm256_div_ps(*real,_mm256_set1_ps(atten));
+    *imag=_mm256_div_ps(*imag,_mm256_set1_ps(atten));
+  }
+}
+
+__attribute__((target("avx2"),always_inline))
+static inline void AddAVX2(float *acc,int stride,__m256 real,__m256 imag) {
+  int k;
+  float rbuf[8],ibuf[8];
+  _mm256_storeu_ps(rbuf,real);
+  _mm256_storeu_ps(ibuf,imag);
+  for (k=0;k<8;k++) {
+    acc[k*stride]=rbuf[k]+acc[k*stride];
+    acc[k*stride+1]=ibuf[k]+acc[k*stride+1];
+  }
+}
+
+__attribute__((target("avx2")))
+static int LagAVX2(int16 *p1,int16 *p2,int16 *pb,int rngoff,int qoff,
+                   int nrng,float atten,float *pwr,float *acf,float *xcf,
+                   int stride) {
+  int n,k;
+  int planar=(rngoff==1);
+  __m256i a;
+  __m256 real,imag;
+  float rbuf[8];
+
+  for (n=0;(n+8)<=nrng;n+=8) {
+    a=LoadAVX2(p1+n*rngoff,qoff,planar);
+    if (pwr !=NULL) {
+      ProductAVX2(a,a,atten,&real,&imag);
+      _mm256_storeu_ps(rbuf,real);
+      for (k=0;k<8;k++) pwr[n+k]=rbuf[k]+pwr[n+k];
+    }
+    ProductAVX2(a,LoadAVX2(p2+n*rngoff,qoff,planar),atten,&real,&imag);
+    AddAVX2(acf+n*stride,stride,real,imag);
+    if (xcf==NULL) continue;
+    ProductAVX2(a,LoadAVX2(pb+n*rngoff,qoff,planar),atten,&real,&imag);
+    AddAVX2(xcf+n*stride,stride,real,imag);
+  }
+  return n;
+}
+
+
+__attribute__((target("avx2"),always_inline))
+static inline void AddExactAVX2(int64_t *acc,int stride,__m256i *t) {
+  int k;
+  int32 tbuf[4][8];
+  for (k=0;k<4;k++) _mm256_storeu_si256((__m256i *) tbuf[k],t[k]);
+  for (k=0;k<8;k++) {
+    acc[k*stride]+=(int64_t) tbuf[0][k]+tbuf[1][k];
+    acc[k*stride+1]+=(int64_t) tbuf[2][k]-tbuf[3][k];
+  }
+}
+
+__attribute__((target("avx2")))
+static int LagExactAVX2(int16 *p1,int16 *p2,int16 *pb,int rngoff,int qoff,
+                        int nrng,int64_t *pwr,int64_t *acf,int64_t *xcf,
+                        int stride) {
+  int n,k;
+  int planar=(rngoff==1);
+  __m256i a,t[4];
+  int32 tbuf[2][8];
+
+  for (n=0;(n+8)<=nrng;n+=8) {
+    a=LoadAVX2(p1+n*rngoff,qoff,planar);
+    if (pwr !=NULL) {
+      TermsAVX2(a,a,t);
+      _mm256_storeu_si256((__m256i *) tbuf[0],t[0]);
+      _mm256_storeu_si256((__m256i *) tbuf[1],t[1]);
+      for (k=0;k<8;k++) pwr[n+k]+=(int64_t) tbuf[0][k]+tbuf[1][k];
+    }
+    TermsAVX2(a,LoadAVX2(p2+n*rngoff,qoff,planar),t);
+    AddExactAVX2(acf+n*stride,stride,t);
+    if (xcf==NULL) continue;
+    TermsAVX2(a,LoadAVX2(pb+n*rngoff,qoff,planar),t);
+    AddExactAVX2(xcf+n*stride,stride,t);
+  }
+  return n;
+}
+
+#endif
+
+/* Where one call's products go: either the float accumulators or,
+   when ipwr0/iacf are set, the exact integer ones. */
+
+struct LagOut {
+  int pwronly;  /* lag-0 power only, the ACF is filled in from it */
+  float atten;
+  float *pwr0,*acf,*xcf;
+  int64_t *ipwr0,*iacf,*ixcf;
+};
+
+/* Power, ACF and XCF for one lag over ranges [rmin,rmax) using the
+   pulse pair at entry l of the lag table. The accumulators start at
+   range rbase. */
+
+static void LagRun(int16 *inbuf,int sampleunit,int offset,int rngoff,
+                   int roffset,int ioffset,int xcfoff,int *lagtable[2],
+                   int l,int lag,int mplgs,int rmin,int rmax,int rbase,
+                   struct LagOut *out) {
+  int n=0;
+  int16 *p1,*p2,*pb;
+  int stride=2*mplgs;
+  int qoff=ioffset-roffset;
+  int nrng=rmax-rmin;
+  int vec=0;
+  int off;
+  float *pwr=NULL,*acf,*xcf=NULL;
+  int64_t *ipwr=NULL,*iacf,*ixcf=NULL;
+
+  if (nrng<=0) return;
+  p1=inbuf+lagtable[0][l]*sampleunit+offset+rmin*rngoff+roffset;
+  p2=inbuf+lagtable[1][l]*sampleunit+offset+rmin*rngoff+roffset;
+  pb=p2+xcfoff;
+  off=(rmin-rbase)*stride+2*lag;
+
+  /* the vector loads need I and Q adjacent or in separate planes */
+  if ((rngoff==1) || ((rngoff==2) && (qoff==1))) vec=ltype;
+
+  if (out->iacf !=NULL) {
+    if ((lag==0) && (out->ipwr0 !=NULL)) ipwr=out->ipwr0+(rmin-rbase);
+    if (out->pwronly) {
+      LagPowerExact(p1,rngoff,qoff,nrng,ipwr);
+      return;
+    }
+    iacf=out->iacf+off;
+    if (out->ixcf !=NULL) ixcf=out->ixcf+off;
+#ifdef LAG_X86
+    if (vec==LAG_AVX2) n=LagExactAVX2(p1,p2,pb,rngoff,qoff,nrng,
+                                      ipwr,iacf,ixcf,stride);
+    else if (vec==LAG_SSE2) n=LagExactSSE2(p1,p2,pb,rngoff,qoff,nrng,
+                                           ipwr,iacf,ixcf,stride);
+#endif
+    if (n<nrng) LagScalarExact(p1+n*rngoff,p2+n*rngoff,pb+n*rngoff,rngoff,
+                               qoff,nrng-n,(ipwr==NULL) ? NULL : ipwr+n,
+                               iacf+n*stride,
+                               (ixcf==NULL) ? NULL : ixcf+n*stride,stride);
+    return;
+  }
+
+  if ((lag==0) && (out->pwr0 !=NULL)) pwr=out->pwr0+(rmin-rbase);
+  acf=out->acf+off;
+  if (out->xcf !=NULL) xcf=out->xcf+off;
+#ifdef LAG_X86
+  if (vec==LAG_AVX2) n=LagAVX2(p1,p2,pb,rngoff,qoff,nrng,out->atten,
+                               pwr,acf,xcf,stride);
+  else if (vec==LAG_SSE2) n=LagSSE2(p1,p2,pb,rngoff,qoff,nrng,out->atten,
+                                    pwr,acf,xcf,stride);
+#endif
+  if (n<nrng) LagScalar(p1+n*rngoff,p2+n*rngoff,pb+n*rngoff,rngoff,qoff,
+                        nrng-n,out->atten,(pwr==NULL) ? NULL : pwr+n,
+                        acf+n*stride,(xcf==NULL) ? NULL : xcf+n*stride,stride);
+}
+
+/* All lags for ranges [rmin,rmax) into accumulators starting at rbase */
+
+static int LagSweep(struct TSGprm *prm,int16 *inbuf,int rngoff,int dflg,
+                    int roffset,int ioffset,int mplgs,int *lagtable[2],
+                    int xcfoff,int badrange,int rbase,int rmin,int rmax,
+                    struct LagOut *out) {
+
+  int sdelay=0;
+  int sampleunit;
+  int offset;
+  int lag;
+  int split;
+
+  if (ltype==-1) SiteTimLagInit();
+
+  if (rmin<0) rmin=0;
+  if (rmax>prm->nrang) rmax=prm->nrang;
+  if (rmax<=rmin) return 0;
+
+  if (dflg) sdelay=prm->smdelay;
+  sampleunit=(prm->mpinc/prm->smsep)*rngoff;
+  offset=sdelay*rngoff;
+
+  /* lag 0 switches to the alternate pulse pair at badrange */
+  split=badrange;
+  if (split<rmin) split=rmin;
+  if (split>rmax) split=rmax;
+
+  for (lag=0;lag<mplgs;lag++) {
+    if (lag==0) {
+      LagRun(inbuf,sampleunit,offset,rngoff,roffset,ioffset,xcfoff,lagtable,
+             0,0,mplgs,rmin,split,rbase,out);
+      LagRun(inbuf,sampleunit,offset,rngoff,roffset,ioffset,xcfoff,lagtable,
+             mplgs,0,mplgs,split,rmax,rbase,out);
+    } else LagRun(inbuf,sampleunit,offset,rngoff,roffset,ioffset,xcfoff,
+                  lagtable,lag,lag,mplgs,rmin,rmax,rbase,out);
+  }
+  return rmax-rmin;
+}
+
+/* Lag products for the range gates [rmin,rmax) only. The accumulators
+   hold just those gates, so pwr0[0] and acfbuf[0] belong to rmin. This
+   lets the gates be shared out between threads. */
+
+int SiteTimLagGates(struct TSGprm *prm,int16 *inbuf,int rngoff,int dflg,
+                    int roffset,int ioffset,int mplgs,int *lagtable[2],
+                    int xcfoff,int badrange,float atten,int rmin,int rmax,
+                    float *pwr0,float *acfbuf,float *xcfbuf) {
+  struct LagOut out;
+
+  memset(&out,0,sizeof(out));
+  out.atten=atten;
+  out.pwr0=pwr0;
+  out.acf=acfbuf;
+  out.xcf=xcfbuf;
+  return LagSweep(prm,inbuf,rngoff,dflg,roffset,ioffset,mplgs,lagtable,
+                  xcfoff,badrange,rmin,rmin,rmax,&out);
+}
+
+int SiteTimLagProducts(struct TSGprm *prm,int16 *inbuf,int rngoff,int dflg,
+                       int roffset,int ioffset,int mplgs,int *lagtable[2],
+                       int xcfoff,int badrange,float atten,
+                       float *pwr0,float *acfbuf,float *xcfbuf) {
+  SiteTimLagGates(prm,inbuf,rngoff,dflg,roffset,ioffset,mplgs,lagtable,
+                  xcfoff,badrange,atten,0,prm->nrang,pwr0,acfbuf,xcfbuf);
+  return 0;
+}
+
+/* Add one sequence into an accumulator holding the gates from rmin.
+   The sums stay exact in integers for as long as the attenuation is
+   unchanged; a different attenuation turns them into floats, each
+   already divided by its own attenuation, and the rest of the
+   integration is summed in single precision as ACFCalculate does.
+
+   If xgate is given, indexed by range, the XCF is only summed for the
+   gates where it is set. The gates are swept in runs that share the
+   same setting. */
+
+int SiteTimLagAccAdd(struct SiteTimLagAcc *ptr,int rmin,struct TSGprm *prm,
+                     int16 *inbuf,int rngoff,int dflg,int roffset,
+                     int ioffset,int *lagtable[2],int xcfoff,int badrange,
+                     float atten,int xcf,unsigned char *xgate) {
+  struct LagOut out;
+  float *fxcf;
+  int64_t *ixcf;
+  int r,rmax,start;
+
+  if (ptr->buf==NULL) return -1;
+  if ((ptr->exact) && (ptr->nseq>0) && (atten !=ptr->atten))
+    SiteTimLagAccFloat(ptr);
+  if (ptr->nseq==0) ptr->atten=atten;
+
+  /* With a single lag, no XCF and both lag-0 pulse pairs made of one
+     pulse, the only ACF term is the power itself; sum just the power
+     and fill the ACF in from it when the sums are converted. */
+  if ((ptr->exact) && (ptr->mplgs==1) && (xcf==0) &&
+      (lagtable[0][0]==lagtable[1][0]) && (lagtable[0][1]==lagtable[1][1]))
+    ptr->pwronly=1;
+
+  memset(&out,0,sizeof(out));
+  out.atten=atten;
+  if (ptr->exact) {
+    out.pwronly=ptr->pwronly;
+    out.ipwr0=ptr->ipwr0;
+    out.iacf=ptr->iacfd;
+    if (xcf) out.ixcf=ptr->ixcfd;
+  } else {
+    out.pwr0=ptr->pwr0;
+    out.acf=ptr->acfd;
+    if (xcf) out.xcf=ptr->xcfd;
+  }
+  rmax=rmin+ptr->nrang;
+  if ((xcf==0) || (xgate==NULL)) {
+    LagSweep(prm,inbuf,rngoff,dflg,roffset,ioffset,ptr->mplgs,lagtable,
+             xcfoff,badrange,rmin,rmin,rmax,&out);
+    ptr->nseq++;
+    return 0;
+  }
+
+  fxcf=out.xcf;
+  ixcf=out.ixcf;
+  r=rmin;
+  while (r<rmax) {
+    start=r;
+    while ((r<rmax) && ((xgate[r]!=0)==(xgate[start]!=0))) r++;
+    out.xcf=(xgate[start]) ? fxcf : NULL;
+    out.ixcf=(xgate[start]) ? ixcf : NULL;
+    LagSweep(prm,inbuf,rngoff,dflg,roffset,ioffset,ptr->mplgs,lagtable,
+             xcfoff,badrange,rmin,start,r,&out);
+  }
+  ptr->nseq++;
+  return 0;
+}
+
+/* Add the current lag-0 power sums into pwr, from range rmin on */
+
+void SiteTimLagAccPower(struct SiteTimLagAcc *ptr,int rmin,float *pwr) {
+  int n;
+  double scale=1.0;
+
+  if (ptr->buf==NULL) return;
+  if (ptr->exact==0) {
+    for (n=0;n<ptr->nrang;n++) pwr[rmin+n]+=ptr->pwr0[n];
+    return;
+  }
+  if (ptr->atten !=0) scale=1.0/ptr->atten;
+  for (n=0;n<ptr->nrang;n++) pwr[rmin+n]+=ptr->ipwr0[n]*scale;
+}
+
+/* Mark the gates whose power is more than factor times the noise, taken
+   as the mean of the ten weakest gates. Returns the gates marked. */
+
+int SiteTimLagGateMask(float *pwr,int nrang,float factor,
+                       unsigned char *mask) {
+  int n,i,j,cnt=0;
+  int nlow=10;
+  float low[10];
+  float noise=0,p;
+
+  if (nrang<=0) return 0;
+  if (nlow>nrang) nlow=nrang;
+  for (n=0;n<nlow;n++) low[n]=pwr[n];
+  for (n=nlow;n<nrang;n++) {
+    p=pwr[n];
+    for (j=0,i=1;i<nlow;i++) if (low[i]>low[j]) j=i;
+    if (p<low[j]) low[j]=p;
+  }
+  for (n=0;n<nlow;n++) noise+=low[n];
+  noise=noise/nlow;
+
+  for (n=0;n<nrang;n++) {
+    mask[n]=(pwr[n]>factor*noise);
+    cnt+=mask[n];
+  }
+  return cnt;
+}
+
+/* Round a block up to a whole number of cache lines */
+
+static int LagAccRound(int n,int unit) {
+  int step=LAG_ALIGN/unit;
+  return (n+step-1)/step*step;
+}
+
+int SiteTimLagAccMake(struct SiteTimLagAcc *ptr,int nrang,int mplgs) {
+  int npwr,nacf;
+  int ipwr,iacf;
+  void *buf=NULL;
+
+  if ((nrang<=0) || (mplgs<=0)) return -1;
+  npwr=LagAccRound(nrang,sizeof(float));
+  nacf=LagAccRound(nrang*2*mplgs,sizeof(float));
+  ipwr=LagAccRound(nrang,sizeof(int64_t));
+  iacf=LagAccRound(nrang*2*mplgs,sizeof(int64_t));
+
+  if ((ptr->buf==NULL) || (ptr->size<npwr+2*nacf)) {
+    if (posix_memalign(&buf,LAG_ALIGN,sizeof(float)*(npwr+2*nacf)) !=0)
+      return -1;
+    if (ptr->buf !=NULL) free(ptr->buf);
+    ptr->buf=buf;
+    ptr->size=npwr+2*nacf;
+  }
+  if ((ptr->ibuf==NULL) || (ptr->isize<ipwr+2*iacf)) {
+    if (posix_memalign(&buf,LAG_ALIGN,sizeof(int64_t)*(ipwr+2*iacf)) !=0)
+      return -1;
+    if (ptr->ibuf !=NULL) free(ptr->ibuf);
+    ptr->ibuf=buf;
+    ptr->isize=ipwr+2*iacf;
+  }
+  ptr->nrang=nrang;
+  ptr->mplgs=mplgs;
+  ptr->pwr0=ptr->buf;
+  ptr->acfd=ptr->buf+npwr;
+  ptr->xcfd=ptr->acfd+nacf;
+  ptr->ipwr0=ptr->ibuf;
+  ptr->iacfd=ptr->ibuf+ipwr;
+  ptr->ixcfd=ptr->iacfd+iacf;
+  SiteTimLagAccZero(ptr);
+  return 0;
+}
+
+void SiteTimLagAccZero(struct SiteTimLagAcc *ptr) {
+  if (ptr->buf==NULL) return;
+  memset(ptr->ipwr0,0,sizeof(int64_t)*ptr->nrang);
+  memset(ptr->iacfd,0,sizeof(int64_t)*ptr->nrang*2*ptr->mplgs);
+  memset(ptr->ixcfd,0,sizeof(int64_t)*ptr->nrang*2*ptr->mplgs);
+  memset(ptr->pwr0,0,sizeof(float)*ptr->nrang);
+  memset(ptr->acfd,0,sizeof(float)*ptr->nrang*2*ptr->mplgs);
+  memset(ptr->xcfd,0,sizeof(float)*ptr->nrang*2*ptr->mplgs);
+  ptr->exact=1;
+  ptr->pwronly=0;
+  ptr->nseq=0;
+  ptr->atten=0;
+}
+
+/* Convert the integer sums to floats, scaled by the attenuation they
+   were taken at. Later sequences are then summed in floats. */
+
+void SiteTimLagAccFloat(struct SiteTimLagAcc *ptr) {
+  int n,nacf;
+  double scale=1.0;
+
+  if ((ptr->buf==NULL) || (ptr->exact==0)) return;
+  if (ptr->atten !=0) scale=1.0/ptr->atten;
+  nacf=ptr->nrang*2*ptr->mplgs;
+  for (n=0;n<ptr->nrang;n++) ptr->pwr0[n]=ptr->ipwr0[n]*scale;
+  for (n=0;n<nacf;n++) ptr->acfd[n]=ptr->iacfd[n]*scale;
+  for (n=0;n<nacf;n++) ptr->xcfd[n]=ptr->ixcfd[n]*scale;
+  if (ptr->pwronly) {
+    for (n=0;n<ptr->nrang;n++) {
+      ptr->acfd[2*n]=ptr->pwr0[n];
+      ptr->acfd[2*n+1]=0;
+    }
+  }
+  ptr->exact=0;
+}
+
+/* Add the sums in src into dst, whose gates start rmin before those
+   of src, and clear src. */
+
+void SiteTimLagAccMerge(struct SiteTimLagAcc *dst,struct SiteTimLagAcc *src,
+                        int rmin,int xcf) {
+  int n,nacf;
+  int stride;
+
+  if ((dst->buf==NULL) || (src->buf==NULL)) return;
+  stride=2*dst->mplgs;
+  nacf=src->nrang*stride;
+  if (rmin+src->nrang>dst->nrang) return;
+  SiteTimLagAccFloat(dst);
+  SiteTimLagAccFloat(src);
+  for (n=0;n<src->nrang;n++) dst->pwr0[rmin+n]+=src->pwr0[n];
+  for (n=0;n<nacf;n++) dst->acfd[rmin*stride+n]+=src->acfd[n];
+  if (xcf) for (n=0;n<nacf;n++) dst->xcfd[rmin*stride+n]+=src->xcfd[n];
+  SiteTimLagAccZero(src);
+}
+
+void SiteTimLagAccCopy(struct SiteTimLagAcc *ptr,float *pwr0,float *acfd,
+                       float *xcfd) {
+  if (ptr->buf==NULL) return;
+  SiteTimLagAccFloat(ptr);
+  memcpy(pwr0,ptr->pwr0,sizeof(float)*ptr->nrang);
+  memcpy(acfd,ptr->acfd,sizeof(float)*ptr->nrang*2*ptr->mplgs);
+  if (xcfd !=NULL)
+    memcpy(xcfd,ptr->xcfd,sizeof(float)*ptr->nrang*2*ptr->mplgs);
+}
@@ -0,0 +1,53 @@
+/* sitelag.h
+   =========
+*/
+
+
+#ifndef _SITELAG_H
+#define _SITELAG_H
+
+struct SiteTimLagAcc {
+  int nrang;
+  int mplgs;
+  int exact;    /* sums are still held in ipwr0, iacfd and ixcfd */
+  int pwronly;  /* only ipwr0 is summed, the lag-0 ACF is the power */
+  int nseq;     /* sequences added since the last zero */
+  float atten;  /* attenuation of the integer sums */
+  int size;     /* floats allocated */
+  float *buf;
+  float *pwr0;  /* nrang */
+  float *acfd;  /* nrang*2*mplgs, same order as the global acfd */
+  float *xcfd;
+  int isize;    /* integers allocated */
+  int64_t *ibuf;
+  int64_t *ipwr0;
+  int64_t *iacfd;
+  int64_t *ixcfd;
+};
+
+int SiteTimLagInit();
+char *SiteTimLagName(int type);
+int SiteTimLagProducts(struct TSGprm *prm,int16 *inbuf,int rngoff,int dflg,
+                       int roffset,int ioffset,int mplgs,int *lagtable[2],
+                       int xcfoff,int badrange,float atten,
+                       float *pwr0,float *acfbuf,float *xcfbuf);
+int SiteTimLagGates(struct TSGprm *prm,int16 *inbuf,int rngoff,int dflg,
+                    int roffset,int ioffset,int mplgs,int *lagtable[2],
+                    int xcfoff,int badrange,float atten,int rmin,int rmax,
+                    float *pwr0,float *acfbuf,float *xcfbuf);
+int SiteTimLagAccMake(struct SiteTimLagAcc *ptr,int nrang,int mplgs);
+void SiteTimLagAccZero(struct SiteTimLagAcc *ptr);
+int SiteTimLagAccAdd(struct SiteTimLagAcc *ptr,int rmin,struct TSGprm *prm,
+                     int16 *inbuf,int rngoff,int dflg,int roffset,
+                     int ioffset,int *lagtable[2],int xcfoff,int badrange,
+                     float atten,int xcf,unsigned char *xgate);
+void SiteTimLagAccPower(struct SiteTimLagAcc *ptr,int rmin,float *pwr);
+int SiteTimLagGateMask(float *pwr,int nrang,float factor,
+                       unsigned char *mask);
+void SiteTimLagAccFloat(struct SiteTimLagAcc *ptr);
+void SiteTimLagAccMerge(struct SiteTimLagAcc *dst,struct SiteTimLagAcc *src,
+                        int rmin,int xcf);
+void SiteTimLagAccCopy(struct SiteTimLagAcc *ptr,float *pwr0,float *acfd,
+                       float *xcfd);
+
+#endif
@@ -0,0 +1,150 @@
+/* sitelink.c
+   ==========
+*/
+/*
+ $License$
+*/
+
+/* Transports to the ROS.
+ *
+ * The ROS is on the same machine at every site, so going through the
+ * loopback TCP stack buys nothing. With the transport set to unix the
+ * control connection is a unix domain stream socket instead; the
+ * messages on it are the same bytes, so TCPIPMsgSend and TCPIPMsgRecv
+ * work on it unchanged. If the socket cannot be reached the connection
+ * falls back to TCP.
+ *
+ * With the transport set to shm the samples also stop going through a
+ * socket at all. The ROS fills a ring of slots in shared memory and
+ * only says which slot in the data reply; the control program decodes
+ * straight out of the slot and then marks it done. The ring is an
+ * extension asked for on the connection, a ROS without it keeps
+ * sending the samples on the socket.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rtypes.h"
+#include "tcpipmsg.h"
+#include "sitelink.h"
+
+char *SiteTimLinkName(int type) {
+  switch (type) {
+    case SITELINK_UNIX:
+      return "unix";
+    case SITELINK_SHM:
+      return "shm";
+    default:
+      return "tcp";
+  }
+}
+
+/* Transport named in the site cfg, -1 if unknown */
+
+int SiteTimLinkType(const char *str) {
+  if (strcmp(str,"tcp")==0) return SITELINK_TCP;
+  if (strcmp(str,"unix")==0) return SITELINK_UNIX;
+  if (strcmp(str,"shm")==0) return SITELINK_SHM;
+  return -1;
+}
+
+static int LinkUnix(char *path) {
+  int sock;
+  struct sockaddr_un addr;
+
+  if ((path==NULL) || (path[0]==0)) return -1;
+  if (strlen(path)>=sizeof(addr.sun_path)) return -1;
+  memset(&addr,0,sizeof(addr));
+  addr.sun_family=AF_UNIX;
+  strcpy(addr.sun_path,path);
+  sock=socket(AF_UNIX,SOCK_STREAM,0);
+  if (sock==-1) return -1;
+  if (connect(sock,(struct sockaddr *) &addr,sizeof(addr)) !=0) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+/* Open the control connection, returns the socket or -1 */
+
+int SiteTimLinkOpen(struct SiteTimLink *ptr,char *host,int port) {
+  int sock;
+
+  if (ptr->type !=SITELINK_TCP) {
+    sock=LinkUnix(ptr->path);
+    if (sock !=-1) return sock;
+    fprintf(stderr,"ROS link: cannot reach %s, using tcp\n",ptr->path);
+  }
+  return TCPIPMsgOpen(host,port);
+}
+
+/* Map the ring the ROS has made, returns zero if it is usable */
+
+int SiteTimLinkRingOpen(struct SiteTimLink *ptr,int rnum,int cnum) {
+  char name[64];
+  struct stat buf;
+  void *base;
+  struct SiteTimLinkRing *ring;
+
+  SiteTimLinkRingClose(ptr);
+  sprintf(name,SITELINK_NAME,rnum,cnum);
+  ptr->shmfd=shm_open(name,O_RDWR,0);
+  if (ptr->shmfd==-1) return -1;
+  if ((fstat(ptr->shmfd,&buf) !=0) || 
+      (buf.st_size<(off_t) sizeof(struct SiteTimLinkRing))) {
+    SiteTimLinkRingClose(ptr);
+    return -1;
+  }
+  base=mmap(NULL,buf.st_size,PROT_READ | PROT_WRITE,MAP_SHARED,
+            ptr->shmfd,0);
+  if (base==MAP_FAILED) {
+    SiteTimLinkRingClose(ptr);
+    return -1;
+  }
+  ptr->ring=base;
+  ptr->sze=buf.st_size;
+  ring=ptr->ring;
+  if ((ring->magic !=SITELINK_MAGIC) || (ring->slots<=0) || 
+      (ring->slotsze<=0) || (ring->hdrsze<(int32) sizeof(*ring)) ||
+      (ring->hdrsze+(size_t) ring->slots*ring->slotsze>ptr->sze)) {
+    SiteTimLinkRingClose(ptr);
+    return -1;
+  }
+  return 0;
+}
+
+void SiteTimLinkRingClose(struct SiteTimLink *ptr) {
+  if (ptr->ring !=NULL) munmap(ptr->ring,ptr->sze);
+  if (ptr->shmfd>0) close(ptr->shmfd);
+  ptr->ring=NULL;
+  ptr->sze=0;
+  ptr->shmfd=0;
+}
+
+/* Main samples of sequence seq, the back samples follow. NULL if the
+   slot cannot hold them. */
+
+uint32 *SiteTimLinkSlot(struct SiteTimLink *ptr,uint32 seq,int samples) {
+  struct SiteTimLinkRing *ring=ptr->ring;
+  if (ring==NULL) return NULL;
+  if ((samples<0) || (2*sizeof(uint32)*samples>(size_t) ring->slotsze))
+    return NULL;
+  return (uint32 *) ((char *) ring+ring->hdrsze+
+                     (size_t) (seq % ring->slots)*ring->slotsze);
+}
+
+/* Hand the slot of sequence seq, and any before it, back to the ROS */
+
+void SiteTimLinkRelease(struct SiteTimLink *ptr,uint32 seq) {
+  if (ptr->ring==NULL) return;
+  __atomic_store_n(&ptr->ring->done,seq+1,__ATOMIC_RELEASE);
+}
@@ -0,0 +1,52 @@
+/* sitelink.h
+   ==========
+*/
+
+
+#ifndef _SITELINK_H
+#define _SITELINK_H
+
+#define SITELINK_TCP 0
+#define SITELINK_UNIX 1
+#define SITELINK_SHM 2
+
+/* Asked for with QUERY_INI_SETTINGS once the connection is made. A ROS
+   that answers 1 has the sample ring below ready under SITELINK_NAME
+   and from then on puts the samples of each GET_DATA reply in it; the
+   reply carries the uint32 sequence number of the slot in place of the
+   main and back arrays. */
+
+#define SITELINK_SHM_SAMPLES "site_settings:shm_samples"
+#define SITELINK_NAME "SampleRing_ROS_%d_%d"
+#define SITELINK_MAGIC 0x52494e47
+
+/* At the head of the ring. Sequence n goes in slot n % slots, main
+   samples first and back samples straight after them. The ROS does not
+   write a slot again until done has passed the sequence in it. */
+
+struct SiteTimLinkRing {
+  int32 magic;
+  int32 slots;
+  int32 slotsze;   /* bytes in each slot */
+  int32 hdrsze;    /* bytes ahead of the first slot */
+  uint32 done;     /* sequences finished with, written by the control
+                      program only */
+};
+
+struct SiteTimLink {
+  int type;          /* transport asked for in the site cfg */
+  char path[256];    /* unix socket of the ROS */
+  int shmfd;
+  size_t sze;
+  struct SiteTimLinkRing *ring;  /* mapped sample ring, NULL if off */
+};
+
+char *SiteTimLinkName(int type);
+int SiteTimLinkType(const char *str);
+int SiteTimLinkOpen(struct SiteTimLink *ptr,char *host,int port);
+int SiteTimLinkRingOpen(struct SiteTimLink *ptr,int rnum,int cnum);
+void SiteTimLinkRingClose(struct SiteTimLink *ptr);
+uint32 *SiteTimLinkSlot(struct SiteTimLink *ptr,uint32 seq,int samples);
+void SiteTimLinkRelease(struct SiteTimLink *ptr,uint32 seq);
+
+#endif
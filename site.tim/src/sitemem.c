@@ -0,0 +1,42 @@
+/* sitemem.c
+   =========
+*/
+/*
+ $License$
+*/
+
+/* Buffers that only ever grow.
+ *
+ * The buffers the sequence and integration loops fill are sized to the
+ * largest request seen and then kept, so once the control program has
+ * been through each of its sequences there is nothing left to allocate.
+ * Every time one of them does have to grow the count goes up, which
+ * SiteTimIntegrate reports; in the steady state it stays put.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sitemem.h"
+
+static unsigned long grown=0;
+
+/* Make room for num entries of sze bytes, max holds the entries there
+   is room for already. Returns zero on success, the buffer is left as
+   it was if it cannot grow. */
+
+int SiteTimGrow(void **ptr,int *max,int num,size_t sze) {
+  void *tmp;
+  if (num<=*max) return 0;
+  tmp=realloc(*ptr,sze*num);
+  if (tmp==NULL) return -1;
+  *ptr=tmp;
+  *max=num;
+  __atomic_add_fetch(&grown,1,__ATOMIC_RELAXED);
+  return 0;
+}
+
+/* Number of times any buffer has had to grow */
+
+unsigned long SiteTimGrowCount() {
+  return __atomic_load_n(&grown,__ATOMIC_RELAXED);
+}
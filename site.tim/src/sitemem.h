@@ -0,0 +1,12 @@
+/* sitemem.h
+   =========
+*/
+
+
+#ifndef _SITEMEM_H
+#define _SITEMEM_H
+
+int SiteTimGrow(void **ptr,int *max,int num,size_t sze);
+unsigned long SiteTimGrowCount();
+
+#endif
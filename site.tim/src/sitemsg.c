@@ -0,0 +1,75 @@
+/* sitemsg.c
+   =========
+*/
+/*
+ $License$
+*/
+
+/* Gathered writes to the ROS.
+ *
+ * The ROS reads each request as a message header followed by its
+ * arguments and answers requests strictly in the order they arrive, so
+ * TCPIPMsgSend of each piece and a single write of all of them put the
+ * same bytes on the socket. Sending a whole request, or several, in one
+ * writev saves a system call per piece and, more to the point, keeps
+ * the header and its arguments from going out as separate small
+ * segments that can sit behind a delayed acknowledgement.
+ *
+ * The replies are read back with TCPIPMsgRecv in the order the
+ * requests were added.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "rtypes.h"
+#include "sitemsg.h"
+
+void SiteTimMsgBatchZero(struct SiteTimMsgBatch *ptr) {
+  ptr->num=0;
+  ptr->sze=0;
+}
+
+int SiteTimMsgBatchAdd(struct SiteTimMsgBatch *ptr,void *buf,size_t sze) {
+  if (sze==0) return 0;
+  if (ptr->num>=SITEMSG_IOV) return -1;
+  ptr->iov[ptr->num].iov_base=buf;
+  ptr->iov[ptr->num].iov_len=sze;
+  ptr->num++;
+  ptr->sze+=sze;
+  return 0;
+}
+
+/* Write everything in the batch, returns the bytes sent or -1 */
+
+int SiteTimMsgBatchSend(int sock,struct SiteTimMsgBatch *ptr) {
+  int i=0;
+  ssize_t s;
+  size_t sent=0;
+  struct iovec *iov=ptr->iov;
+  int num=ptr->num;
+
+  while (i<num) {
+    s=writev(sock,iov+i,num-i);
+    if (s<0) {
+      if (errno==EINTR) continue;
+      return -1;
+    }
+    sent+=s;
+    /* step over what went out and trim a partly written piece */
+    while ((i<num) && ((size_t) s>=iov[i].iov_len)) {
+      s-=iov[i].iov_len;
+      i++;
+    }
+    if (i<num) {
+      iov[i].iov_base=(char *) iov[i].iov_base+s;
+      iov[i].iov_len-=s;
+    }
+  }
+  SiteTimMsgBatchZero(ptr);
+  return (int) sent;
+}
@@ -0,0 +1,63 @@
+/* sitemsg.h
+   =========
+*/
+
+
+#ifndef _SITEMSG_H
+#define _SITEMSG_H
+
+#define SITEMSG_IOV 16 /* pieces gathered into one write */
+
+/* ROS extensions are switched on for a connection by asking for their
+   ini entry with QUERY_INI_SETTINGS; a ROS that supports one answers 1
+   and from then on uses it, any other answer leaves the protocol as
+   it was. */
+
+#define SITEMSG_DATA_STATUS "site_settings:data_status"
+#define SITEMSG_WAIT_FOR_DATA "site_settings:wait_for_data"
+#define SITEMSG_DATA_CHANNEL "site_settings:data_channel"
+
+/* WAIT_FOR_DATA carries an int32 timeout in usec after the ROSMsg. The
+   reply comes as soon as the samples for the sequence are in, status 1,
+   or once the timeout has passed, status 0. */
+
+#ifndef WAIT_FOR_DATA
+#define WAIT_FOR_DATA 'W'
+#endif
+
+/* The data channel entry is answered with a token, 0 if there is none.
+   A second connection opened with DATA_CHANNEL followed by int32 rnum,
+   cnum and the token is answered with status 1 once it is bound to the
+   first. From then the main and back samples, unless they are in the
+   sample ring, and the bad TR times of each GET_DATA reply go on it in
+   the same order; the rest of the reply stays on the control
+   connection. The control program may send the next requests before
+   it reads the bulk part; until it has, it waits on both connections
+   for their replies, so a ROS that writes the whole of each reply
+   before reading on is served as well. */
+
+#ifndef DATA_CHANNEL
+#define DATA_CHANNEL 'B'
+#endif
+
+/* Sent after the samples and before the closing ROSMsg of each data
+   reply when the data status is on */
+
+struct SiteTimDataStatus {
+  int32 tbeam;   /* beam and frequencies the sequence was taken on */
+  int32 tfreq;
+  int32 rfreq;
+  int32 status;  /* ControlPRM status */
+};
+
+struct SiteTimMsgBatch {
+  int num;
+  size_t sze;
+  struct iovec iov[SITEMSG_IOV];
+};
+
+void SiteTimMsgBatchZero(struct SiteTimMsgBatch *ptr);
+int SiteTimMsgBatchAdd(struct SiteTimMsgBatch *ptr,void *buf,size_t sze);
+int SiteTimMsgBatchSend(int sock,struct SiteTimMsgBatch *ptr);
+
+#endif
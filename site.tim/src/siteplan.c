@@ -0,0 +1,159 @@
+/* siteplan.c
+   ==========
+*/
+/*
+ $License$
+*/
+
+/* Integration plan.
+ *
+ * Everything SiteTimIntegrate needs that only depends on the registered
+ * sequence and the lag table is worked out here once and kept until the
+ * sequence is registered again: the sample counts, the sample rate and
+ * the sequence-fixed fields of the ControlPRM, built by SiteTimPlanSeq
+ * from SiteTimTimeSeq; and the lag tables, lag sums, bad lag-0 range,
+ * the samples the ACF reads and the far range window for the noise
+ * estimate, built by SiteTimPlanLags on the first integration with a
+ * given lag table.
+ *
+ * Within the ACF the range gates are consecutive samples: range r of
+ * pulse position p is sample p*pulsesmp+skpnum+r.
+ *
+ * Later integrations with the same lags only compare the table against
+ * the plan, there is no allocation or recalculation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rtypes.h"
+#include "limit.h"
+#include "tsg.h"
+#include "acf.h"
+#include "rosmsg.h"
+#include "sitemem.h"
+#include "siteplan.h"
+
+/* Number of samples per sequence that the lag-0 power, ACF and XCF
+ * calculations actually read. ACFCalculate and ACFSumPower address
+ * sample pos*(mpinc/smsep)+range+smdelay for every pulse position in
+ * the lag table, including the alternate lag-0 entry at mplgs. The
+ * first gate sits lagfr/smsep samples after the pulse, which is kept
+ * on top as margin. */
+
+static int PlanACFSamples(struct TSGprm *prm,int mplgs,int *lagtable[2]) {
+  int i;
+  int pos=0;
+  if (prm->smsep<=0) return prm->samples+prm->smdelay;
+  for (i=0;i<=mplgs;i++) {
+    if (lagtable[0][i]>pos) pos=lagtable[0][i];
+    if (lagtable[1][i]>pos) pos=lagtable[1][i];
+  }
+  return pos*(prm->mpinc/prm->smsep)+prm->lagfr/prm->smsep+
+         prm->smdelay+prm->nrang;
+}
+
+int SiteTimPlanSeq(struct SiteTimPlan *ptr,struct TSGprm *prm,int index,
+                   int nbaud,int txpl,int dmatch,int cnum) {
+  ptr->valid=0;
+  ptr->lagvalid=0;
+  if (txpl<=0) return -1;
+
+  ptr->total=prm->samples+prm->smdelay;
+  ptr->skpnum=prm->smdelay;
+  ptr->pulsesmp=(prm->smsep>0) ? prm->mpinc/prm->smsep : 0;
+
+  memset(&ptr->rprm,0,sizeof(struct ControlPRM));
+  ptr->rprm.trise=5000;
+  ptr->rprm.baseband_samplerate=((double)nbaud/(double)txpl)*1E6;
+  ptr->rprm.filter_bandwidth=ptr->rprm.baseband_samplerate;
+  ptr->rprm.match_filter=dmatch;
+  ptr->rprm.number_of_samples=ptr->total+nbaud+10;
+  ptr->rprm.priority=cnum;
+  ptr->rprm.current_pulseseq_index=index;
+  ptr->rprm.buffer_index=0;
+
+  ptr->valid=1;
+  return 0;
+}
+
+/* Bring the lag part of the plan up to date. Returns 0 if the plan
+   already matched, 1 if it was rebuilt and -1 on error. */
+
+int SiteTimPlanLags(struct SiteTimPlan *ptr,struct TSGprm *prm,
+                    int (*lags)[2],int mplgs,int mplgexs,int nbaud,int nfar) {
+  int i,j;
+  int nlag;
+  int max;
+
+  if (ptr->valid==0) return -1;
+  nlag=((mplgexs==0) ? mplgs : mplgexs)+1;
+  if (nlag<=0) return -1;
+
+  if ((ptr->lagvalid) && (ptr->mplgs==mplgs) && (ptr->mplgexs==mplgexs) &&
+      (ptr->nfar==nfar)) {
+    for (i=0;i<nlag;i++) {
+      if (ptr->lagtable[0][i] !=lags[i][0]) break;
+      if (ptr->lagtable[1][i] !=lags[i][1]) break;
+    }
+    if (i==nlag) return 0;
+  }
+
+  ptr->lagvalid=0;
+  max=ptr->lagmax;
+  if (SiteTimGrow((void **) &ptr->lagtable[0],&max,nlag,sizeof(int)) !=0)
+    return -1;
+  if (SiteTimGrow((void **) &ptr->lagtable[1],&ptr->lagmax,nlag,
+                  sizeof(int)) !=0) return -1;
+
+  ptr->mplgs=mplgs;
+  ptr->mplgexs=mplgexs;
+  ptr->nlag=nlag;
+  for (j=0;j<LAG_SIZE;j++) ptr->lagsum[j]=0;
+  for (i=0;i<nlag;i++) {
+    ptr->lagtable[0][i]=lags[i][0];
+    ptr->lagtable[1][i]=lags[i][1];
+    if (mplgexs !=0) {
+      j=abs(lags[i][0]-lags[i][1]);
+      ptr->lagsum[j]++;
+    }
+  }
+
+  /* Only decode, copy and request the samples the ACF reaches. ACFEX
+     uses the whole sequence so keeps the full count. */
+  ptr->acfsmp=ptr->total;
+  if (mplgexs==0) {
+    ptr->acfsmp=PlanACFSamples(prm,mplgs,ptr->lagtable);
+    if (ptr->acfsmp>ptr->total) ptr->acfsmp=ptr->total;
+  }
+  ptr->rossmp=ptr->acfsmp+nbaud+10;
+  ptr->badrng=ACFBadLagZero(prm,mplgs,ptr->lagtable);
+  ptr->rprm.number_of_samples=ptr->rossmp;
+  ptr->usecs=(int)(ptr->rprm.number_of_samples/
+                   ptr->rprm.baseband_samplerate*1E6);
+
+  /* the far range noise estimate uses the lag-0 pulse of the last
+     nfar ranges */
+  ptr->nfar=nfar;
+  ptr->farnum=nfar;
+  if (ptr->farnum>prm->nrang) ptr->farnum=prm->nrang;
+  if (ptr->farnum<0) ptr->farnum=0;
+  ptr->farsmp=ptr->lagtable[0][0]*ptr->pulsesmp+ptr->skpnum+
+              prm->nrang-ptr->farnum;
+
+  ptr->lagvalid=1;
+  return 1;
+}
+
+/* Copy the sequence-fixed fields into the parameters sent to the ROS */
+
+void SiteTimPlanPrm(struct SiteTimPlan *ptr,struct ControlPRM *rprm) {
+  rprm->trise=ptr->rprm.trise;
+  rprm->baseband_samplerate=ptr->rprm.baseband_samplerate;
+  rprm->filter_bandwidth=ptr->rprm.filter_bandwidth;
+  rprm->match_filter=ptr->rprm.match_filter;
+  rprm->number_of_samples=ptr->rprm.number_of_samples;
+  rprm->priority=ptr->rprm.priority;
+  rprm->current_pulseseq_index=ptr->rprm.current_pulseseq_index;
+  rprm->buffer_index=ptr->rprm.buffer_index;
+}
@@ -0,0 +1,38 @@
+/* siteplan.h
+   ==========
+*/
+
+
+#ifndef _SITEPLAN_H
+#define _SITEPLAN_H
+
+struct SiteTimPlan {
+  int valid;        /* sequence part built for the registered sequence */
+  int total;        /* samples per sequence including smdelay */
+  int skpnum;       /* smdelay, the samples ahead of the first range */
+  int pulsesmp;     /* samples between pulse positions, mpinc/smsep */
+  struct ControlPRM rprm; /* fields fixed by the sequence, see SiteTimPlanPrm */
+
+  int lagvalid;     /* lag part built for the lags below */
+  int mplgs;
+  int mplgexs;
+  int nlag;         /* entries in each lag table, alternate lag-0 included */
+  int lagmax;       /* entries allocated */
+  int *lagtable[2];
+  int lagsum[LAG_SIZE];
+  int badrng;       /* first range using the alternate lag-0 pair */
+  int acfsmp;       /* samples per sequence read by the ACF */
+  int rossmp;       /* samples requested from the ROS */
+  int usecs;        /* time to collect rossmp samples */
+  int nfar;         /* far ranges used for the noise median */
+  int farsmp;       /* sample of the lag-0 pulse at the first far range */
+  int farnum;
+};
+
+int SiteTimPlanSeq(struct SiteTimPlan *ptr,struct TSGprm *prm,int index,
+                   int nbaud,int txpl,int dmatch,int cnum);
+int SiteTimPlanLags(struct SiteTimPlan *ptr,struct TSGprm *prm,
+                    int (*lags)[2],int mplgs,int mplgexs,int nbaud,int nfar);
+void SiteTimPlanPrm(struct SiteTimPlan *ptr,struct ControlPRM *rprm);
+
+#endif
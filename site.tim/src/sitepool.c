@@ -0,0 +1,224 @@
+/* sitepool.c
+   ==========
+*/
+/*
+ $License$
+*/
+
+/* Worker pool for the lag-product accumulation.
+ *
+ * The range gates are independent, so each sequence's lag products are
+ * shared out in contiguous chunks of gates between a set of persistent
+ * threads, with the calling thread taking the first chunk. The call
+ * returns once every chunk is done, so the samples can be reused
+ * straight away.
+ *
+ * Each worker accumulates into its own SiteTimLagAcc, allocated on a
+ * cache line boundary, rather than into the shared acfd arrays. A gate
+ * is only ever summed by one worker and in sequence order, so when the
+ * blocks are merged back at the end of the integration the results are
+ * the same as a single thread would give.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "rtypes.h"
+#include "tsg.h"
+#include "sitelag.h"
+#include "sitepool.h"
+
+#define POOL_CHUNK 8 /* gates per chunk are rounded to the vector width */
+
+struct PoolWorker {
+  pthread_t thread;
+  int rmin,rmax;
+  struct SiteTimLagAcc acc;
+};
+
+struct PoolJob {
+  struct TSGprm *prm;
+  int16 *inbuf;
+  int rngoff,dflg;
+  int roffset,ioffset;
+  int *lagtable[2];
+  int xcfoff,badrange;
+  float atten;
+  int xcf;
+  unsigned char *xgate;
+};
+
+static struct {
+  int nthr;
+  pthread_mutex_t lock;
+  pthread_cond_t go;
+  pthread_cond_t done;
+  unsigned int gen;
+  int pending;
+  struct PoolJob job;
+  struct PoolWorker *worker;
+} pool={.nthr=1,
+        .lock=PTHREAD_MUTEX_INITIALIZER,
+        .go=PTHREAD_COND_INITIALIZER,
+        .done=PTHREAD_COND_INITIALIZER};
+
+static void PoolWork(struct PoolWorker *ptr) {
+  struct PoolJob *job=&pool.job;
+  if (ptr->rmax<=ptr->rmin) return;
+  SiteTimLagAccAdd(&ptr->acc,ptr->rmin,job->prm,job->inbuf,job->rngoff,
+                   job->dflg,job->roffset,job->ioffset,job->lagtable,
+                   job->xcfoff,job->badrange,job->atten,job->xcf,
+                   job->xgate);
+}
+
+static void *PoolThread(void *arg) {
+  struct PoolWorker *ptr=(struct PoolWorker *) arg;
+  unsigned int seen=0;
+
+  while (1) {
+    pthread_mutex_lock(&pool.lock);
+    while (pool.gen==seen) pthread_cond_wait(&pool.go,&pool.lock);
+    seen=pool.gen;
+    pthread_mutex_unlock(&pool.lock);
+
+    PoolWork(ptr);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.pending--;
+    if (pool.pending==0) pthread_cond_signal(&pool.done);
+    pthread_mutex_unlock(&pool.lock);
+  }
+  return NULL;
+}
+
+/* Start nthr-1 worker threads; the caller is the remaining one. */
+
+int SiteTimPoolStart(int nthr) {
+  int i;
+
+  if (pool.worker !=NULL) return pool.nthr;
+  if (nthr<1) nthr=1;
+
+  pool.worker=malloc(sizeof(struct PoolWorker)*nthr);
+  if (pool.worker==NULL) {
+    pool.nthr=1;
+    return 1;
+  }
+  memset(pool.worker,0,sizeof(struct PoolWorker)*nthr);
+  pool.nthr=1;
+  for (i=1;i<nthr;i++) {
+    if (pthread_create(&pool.worker[i].thread,NULL,PoolThread,
+                       &pool.worker[i]) !=0) {
+      fprintf(stderr,"SiteTimPoolStart: only %d of %d threads started\n",
+              i,nthr);
+      break;
+    }
+    pthread_detach(pool.worker[i].thread);
+    pool.nthr++;
+  }
+  return pool.nthr;
+}
+
+int SiteTimPoolSize() {
+  return pool.nthr;
+}
+
+/* Share out the gates and clear the blocks at the start of an
+   integration. If this fails the pool must not be used until it has
+   succeeded again. */
+
+int SiteTimPoolBegin(int nrang,int mplgs) {
+  int i,chunk;
+  struct PoolWorker *ptr;
+
+  if (pool.worker==NULL) return -1;
+
+  chunk=(nrang+pool.nthr-1)/pool.nthr;
+  chunk=(chunk+POOL_CHUNK-1)/POOL_CHUNK*POOL_CHUNK;
+
+  for (i=0;i<pool.nthr;i++) {
+    ptr=&pool.worker[i];
+    ptr->rmin=i*chunk;
+    ptr->rmax=ptr->rmin+chunk;
+    if (ptr->rmin>nrang) ptr->rmin=nrang;
+    if (ptr->rmax>nrang) ptr->rmax=nrang;
+    if (ptr->rmax<=ptr->rmin) continue;
+    if ((ptr->acc.nrang==ptr->rmax-ptr->rmin) && (ptr->acc.mplgs==mplgs)) {
+      SiteTimLagAccZero(&ptr->acc);
+      continue;
+    }
+    if (SiteTimLagAccMake(&ptr->acc,ptr->rmax-ptr->rmin,mplgs) !=0) {
+      /* make sure the next integration lays this one out again */
+      ptr->acc.nrang=0;
+      ptr->acc.mplgs=0;
+      fprintf(stderr,"SiteTimPoolBegin: cannot allocate accumulators\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int SiteTimPoolLagProducts(struct TSGprm *prm,int16 *inbuf,int rngoff,
+                           int dflg,int roffset,int ioffset,
+                           int *lagtable[2],int xcfoff,int badrange,
+                           float atten,int xcf,unsigned char *xgate) {
+  struct PoolJob *job=&pool.job;
+
+  job->prm=prm;
+  job->inbuf=inbuf;
+  job->rngoff=rngoff;
+  job->dflg=dflg;
+  job->roffset=roffset;
+  job->ioffset=ioffset;
+  job->lagtable[0]=lagtable[0];
+  job->lagtable[1]=lagtable[1];
+  job->xcfoff=xcfoff;
+  job->badrange=badrange;
+  job->atten=atten;
+  job->xcf=xcf;
+  job->xgate=xgate;
+
+  pthread_mutex_lock(&pool.lock);
+  pool.pending=pool.nthr-1;
+  pool.gen++;
+  pthread_cond_broadcast(&pool.go);
+  pthread_mutex_unlock(&pool.lock);
+
+  PoolWork(&pool.worker[0]);
+
+  pthread_mutex_lock(&pool.lock);
+  while (pool.pending>0) pthread_cond_wait(&pool.done,&pool.lock);
+  pthread_mutex_unlock(&pool.lock);
+  return 0;
+}
+
+/* Merge each worker's sums into the integration accumulator and
+   clear them again. */
+
+void SiteTimPoolEnd(struct SiteTimLagAcc *acc,int xcf) {
+  int i;
+  struct PoolWorker *ptr;
+
+  if (pool.worker==NULL) return;
+  for (i=0;i<pool.nthr;i++) {
+    ptr=&pool.worker[i];
+    if (ptr->rmax<=ptr->rmin) continue;
+    SiteTimLagAccMerge(acc,&ptr->acc,ptr->rmin,xcf);
+  }
+}
+
+/* Add the workers' current lag-0 power into pwr */
+
+void SiteTimPoolPower(float *pwr) {
+  int i;
+  struct PoolWorker *ptr;
+
+  if (pool.worker==NULL) return;
+  for (i=0;i<pool.nthr;i++) {
+    ptr=&pool.worker[i];
+    if (ptr->rmax<=ptr->rmin) continue;
+    SiteTimLagAccPower(&ptr->acc,ptr->rmin,pwr);
+  }
+}
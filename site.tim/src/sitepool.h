@@ -0,0 +1,19 @@
+/* sitepool.h
+   ==========
+*/
+
+
+#ifndef _SITEPOOL_H
+#define _SITEPOOL_H
+
+int SiteTimPoolStart(int nthr);
+int SiteTimPoolSize();
+int SiteTimPoolBegin(int nrang,int mplgs);
+int SiteTimPoolLagProducts(struct TSGprm *prm,int16 *inbuf,int rngoff,
+                           int dflg,int roffset,int ioffset,
+                           int *lagtable[2],int xcfoff,int badrange,
+                           float atten,int xcf,unsigned char *xgate);
+void SiteTimPoolEnd(struct SiteTimLagAcc *acc,int xcf);
+void SiteTimPoolPower(float *pwr);
+
+#endif
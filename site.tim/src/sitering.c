@@ -0,0 +1,174 @@
+/* sitering.c
+   ==========
+*/
+/*
+ $License$
+*/
+
+/* Sequence ring for pipelined acquisition.
+ *
+ * The thread talking to the ROS fills a slot with one sequence's data
+ * reply and pushes it; a single worker thread takes the slots in order
+ * and runs the processing on them, so the next sequence can be armed
+ * while the last one is decoded and summed.
+ *
+ * There is one producer and one consumer. Each owns one of the ring
+ * indices and only reads the other, so the slots are handed over with
+ * an atomic store and load and no lock. A side that finds the ring
+ * empty or full polls the other index for a short while and only then
+ * sleeps on its semaphore. It flags that it is going to sleep and looks
+ * once more before it does; the other side posts only when it sees the
+ * flag, so there is no system call while both keep up.
+ *
+ * Without the worker, or with async off, SiteTimRingPush runs the
+ * processing straight away on the calling thread, the same as the
+ * serial loop always did.
+ *
+ * The slot buffers grow to the largest reply seen and are then reused.
+ * A slot's main and back point either at them or, when the reply was
+ * received straight into the IQ segment, at that.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/time.h>
+#include "rtypes.h"
+#include "rosmsg.h"
+#include "sitemem.h"
+#include "sitering.h"
+
+#define RING_SPIN 256 /* polls of the other index before sleeping */
+
+static void RingWait(sem_t *sem) {
+  while (sem_wait(sem) !=0) if (errno !=EINTR) break;
+}
+
+/* Consumer side, wait for the producer to move head past idx */
+
+static void RingWaitHead(struct SiteTimRing *ptr,unsigned int idx) {
+  int k;
+
+  while (1) {
+    for (k=0;k<RING_SPIN;k++)
+      if (__atomic_load_n(&ptr->head,__ATOMIC_ACQUIRE) !=idx) return;
+    __atomic_store_n(&ptr->cwait,1,__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ptr->head,__ATOMIC_SEQ_CST) !=idx) {
+      __atomic_store_n(&ptr->cwait,0,__ATOMIC_RELAXED);
+      return;
+    }
+    RingWait(&ptr->full);
+  }
+}
+
+/* Producer side, wait until no more than n slots are still in use */
+
+static void RingWaitTail(struct SiteTimRing *ptr,unsigned int n) {
+  int k;
+
+  while (1) {
+    for (k=0;k<RING_SPIN;k++)
+      if ((ptr->head-__atomic_load_n(&ptr->tail,__ATOMIC_ACQUIRE))<=n)
+        return;
+    __atomic_store_n(&ptr->pwait,1,__ATOMIC_SEQ_CST);
+    if ((ptr->head-__atomic_load_n(&ptr->tail,__ATOMIC_SEQ_CST))<=n) {
+      __atomic_store_n(&ptr->pwait,0,__ATOMIC_RELAXED);
+      return;
+    }
+    RingWait(&ptr->free);
+  }
+}
+
+static void *RingThread(void *arg) {
+  struct SiteTimRing *ptr=(struct SiteTimRing *) arg;
+  unsigned int idx;
+
+  while (1) {
+    idx=__atomic_load_n(&ptr->tail,__ATOMIC_RELAXED);
+    RingWaitHead(ptr,idx);
+    ptr->proc(&ptr->slot[idx % ptr->num]);
+    __atomic_store_n(&ptr->tail,idx+1,__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&ptr->pwait,0,__ATOMIC_SEQ_CST))
+      sem_post(&ptr->free);
+  }
+  return NULL;
+}
+
+/* Set the processing and, with thread set, start the worker. Returns
+   zero unless the worker was asked for and could not be started. */
+
+int SiteTimRingStart(struct SiteTimRing *ptr,SiteTimSlotProc proc,
+                     int thread) {
+  pthread_t thr;
+
+  ptr->proc=proc;
+  if (ptr->num==0) ptr->num=SITERING_SLOTS;
+  if ((thread==0) || (ptr->thread)) return 0;
+  ptr->head=0;
+  ptr->tail=0;
+  ptr->async=0;
+  ptr->cwait=0;
+  ptr->pwait=0;
+  if (sem_init(&ptr->full,0,0) !=0) return -1;
+  if (sem_init(&ptr->free,0,0) !=0) return -1;
+  if (pthread_create(&thr,NULL,RingThread,ptr) !=0) return -1;
+  pthread_detach(thr);
+  ptr->thread=1;
+  return 0;
+}
+
+/* Switch between the worker and running inline. Only called with the
+   ring drained. */
+
+void SiteTimRingMode(struct SiteTimRing *ptr,int async) {
+  if (ptr->num==0) ptr->num=SITERING_SLOTS;
+  ptr->async=(async) && (ptr->thread);
+}
+
+/* Make room for a reply of samples and trnum bad TR entries */
+
+int SiteTimRingSlotSize(struct SiteTimSlot *slot,int samples,int trnum) {
+  int max;
+
+  max=slot->size;
+  if (SiteTimGrow((void **) &slot->mbuf,&max,samples,sizeof(uint32)) !=0)
+    return -1;
+  if (SiteTimGrow((void **) &slot->bbuf,&slot->size,samples,
+                  sizeof(uint32)) !=0) return -1;
+  max=slot->trmax;
+  if (SiteTimGrow((void **) &slot->badtr.start_usec,&max,trnum,
+                  sizeof(uint32)) !=0) return -1;
+  if (SiteTimGrow((void **) &slot->badtr.duration_usec,&slot->trmax,trnum,
+                  sizeof(uint32)) !=0) return -1;
+  return 0;
+}
+
+/* The slot to fill next, waiting for the worker if the ring is full */
+
+struct SiteTimSlot *SiteTimRingClaim(struct SiteTimRing *ptr) {
+  if (ptr->num==0) ptr->num=SITERING_SLOTS;
+  if (ptr->async) RingWaitTail(ptr,ptr->num-1);
+  return &ptr->slot[ptr->head % ptr->num];
+}
+
+void SiteTimRingPush(struct SiteTimRing *ptr) {
+  if (ptr->async) {
+    __atomic_store_n(&ptr->head,ptr->head+1,__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&ptr->cwait,0,__ATOMIC_SEQ_CST))
+      sem_post(&ptr->full);
+    return;
+  }
+  ptr->proc(&ptr->slot[ptr->head % ptr->num]);
+  ptr->head++;
+  ptr->tail=ptr->head;
+}
+
+/* Wait until the worker has been through every slot pushed */
+
+void SiteTimRingDrain(struct SiteTimRing *ptr) {
+  if (ptr->async==0) return;
+  RingWaitTail(ptr,0);
+}
@@ -0,0 +1,52 @@
+/* sitering.h
+   ==========
+*/
+
+
+#ifndef _SITERING_H
+#define _SITERING_H
+
+#define SITERING_SLOTS 4
+
+struct SiteTimSlot {
+  struct DataPRM dprm;
+  int32 tbeam;          /* beam and frequency the ROS reported */
+  int32 tfreq;
+  int newbeam;          /* the ROS moved beam, log only and end there */
+  struct timeval tick;  /* when the sequence was armed */
+  uint32 *main,*back;   /* the samples, in mbuf and bbuf or straight in
+                           the IQ segment */
+  int size;             /* samples allocated in mbuf and bbuf */
+  uint32 *mbuf,*bbuf;
+  int inring;           /* main and back are in the ROS sample ring */
+  uint32 ringseq;       /* the sequence number of that slot */
+  int trmax;            /* entries allocated for the bad TR times */
+  struct TRTimes badtr;
+  int ntx;
+  struct TXStatus tx;
+};
+
+typedef void (*SiteTimSlotProc)(struct SiteTimSlot *slot);
+
+struct SiteTimRing {
+  int num;
+  struct SiteTimSlot slot[SITERING_SLOTS];
+  unsigned int head;    /* written by the producer only */
+  unsigned int tail;    /* written by the consumer only */
+  int cwait,pwait;      /* the consumer or producer is going to sleep */
+  sem_t full;           /* wakes the consumer once head has moved */
+  sem_t free;           /* wakes the producer once tail has moved */
+  int async;            /* slots are handed to the worker thread */
+  int thread;           /* worker started */
+  SiteTimSlotProc proc;
+};
+
+int SiteTimRingStart(struct SiteTimRing *ptr,SiteTimSlotProc proc,
+                     int thread);
+void SiteTimRingMode(struct SiteTimRing *ptr,int async);
+struct SiteTimSlot *SiteTimRingClaim(struct SiteTimRing *ptr);
+int SiteTimRingSlotSize(struct SiteTimSlot *slot,int samples,int trnum);
+void SiteTimRingPush(struct SiteTimRing *ptr);
+void SiteTimRingDrain(struct SiteTimRing *ptr);
+
+#endif
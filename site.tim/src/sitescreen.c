@@ -0,0 +1,82 @@
+/* sitescreen.c
+   ============
+*/
+/*
+ $License$
+*/
+
+/* Per-sequence screening for saturation and interference.
+ *
+ * The peak and clip statistics are gathered by the decode and copy
+ * kernels in sitedecode.c as the samples are read, so the received
+ * sequence is only passed over once.
+ *
+ * SiteTimScreenMedian gives the median lag-0 power of a run of decoded
+ * samples, the far ranges, as a noise estimate for the sequence. It is
+ * run on the main array straight after it is decoded, while the
+ * samples are still in cache.
+ *
+ * SiteTimScreenTest compares the statistics with the limits from the
+ * site cfg; a limit of zero is not applied.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rtypes.h"
+#include "sitemem.h"
+#include "sitescreen.h"
+
+static float *work=NULL;
+static int wmax=0;
+
+static float Select(float *x,int n,int k) {
+  int lo=0,hi=n-1;
+  int i,j;
+  float p,t;
+
+  while (lo<hi) {
+    p=x[(lo+hi)/2];
+    i=lo;
+    j=hi;
+    while (i<=j) {
+      while (x[i]<p) i++;
+      while (x[j]>p) j--;
+      if (i<=j) {
+        t=x[i];
+        x[i]=x[j];
+        x[j]=t;
+        i++;
+        j--;
+      }
+    }
+    if (k<=j) hi=j;
+    else if (k>=i) lo=i;
+    else break;
+  }
+  return x[k];
+}
+
+/* Median of I*I+Q*Q over n samples step int16 apart */
+
+float SiteTimScreenMedian(int16 *iptr,int16 *qptr,int step,int n) {
+  int i;
+  float re,im;
+
+  if (n<=0) return 0;
+  if (SiteTimGrow((void **) &work,&wmax,n,sizeof(float)) !=0) return 0;
+  for (i=0;i<n;i++) {
+    re=iptr[i*step];
+    im=qptr[i*step];
+    work[i]=re*re+im*im;
+  }
+  return Select(work,n,n/2);
+}
+
+int SiteTimScreenTest(struct SiteTimScreen *ptr,
+                      struct SiteTimScreenStat *stat) {
+  if ((ptr->peak>0) && (stat->peak>ptr->peak)) return SCREEN_PEAK;
+  if ((ptr->clip>0) && (stat->clip>ptr->clip)) return SCREEN_CLIP;
+  if ((ptr->noise>0) && (stat->noise>ptr->noise)) return SCREEN_NOISE;
+  return SCREEN_KEEP;
+}
@@ -0,0 +1,36 @@
+/* sitescreen.h
+   ============
+*/
+
+
+#ifndef _SITESCREEN_H
+#define _SITESCREEN_H
+
+#define SCREEN_KEEP 0
+#define SCREEN_PEAK 1
+#define SCREEN_CLIP 2
+#define SCREEN_NOISE 3
+
+struct SiteTimScreen {
+  int on;
+  int level;    /* component magnitude counted as clipped */
+  int peak;     /* drop above this peak magnitude, 0 for no limit */
+  int clip;     /* drop above this many clipped components, 0 for no limit */
+  float noise;  /* drop above this far range median power, 0 for no limit */
+  int nfar;     /* far ranges used for the median */
+};
+
+/* one record per sequence in the seqstat file, see SiteTimScreenLog */
+
+struct SiteTimScreenStat {
+  int32 peak;   /* largest I or Q magnitude */
+  int32 clip;   /* I and Q components at or above the clip level */
+  float noise;  /* median lag-0 power over the far ranges */
+  int32 drop;   /* SCREEN_ reason the sequence was dropped */
+};
+
+float SiteTimScreenMedian(int16 *iptr,int16 *qptr,int step,int n);
+int SiteTimScreenTest(struct SiteTimScreen *ptr,
+                      struct SiteTimScreenStat *stat);
+
+#endif
@@ -0,0 +1,336 @@
+/* sitetsg.c
+   =========
+*/
+/*
+ $License$
+*/
+
+/* Pulse sequence cache.
+ *
+ * A control program that alternates between a few sequences used to
+ * rebuild the timing sequence with TSGMake and send the whole of it to
+ * the ROS as index 0 every time it changed. Here each sequence made is
+ * kept, keyed by a hash of the parameters it was made from, and given
+ * its own index on the ROS. Selecting a sequence that is already held
+ * only has to find it again; the integration then asks the ROS for it
+ * by index.
+ *
+ * The table holds up to SITE_SEQ_MAX sequences, fewer if the site cfg
+ * says so, and the one selected longest ago gives up its slot and its
+ * ROS index when it is full.
+ *
+ * If a directory is given the TSGMake output is also kept on disk, one
+ * file per sequence named by the hash, and read back the next time the
+ * same sequence is made, including by later runs. A file that cannot be
+ * read or does not match is ignored and the sequence is made again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "rtypes.h"
+#include "tsg.h"
+#include "maketsg.h"
+#include "sitetsg.h"
+
+#define TSG_MAGIC 0x54534731 /* "TSG1" */
+#define TSG_IN 12            /* parameters a sequence is made from */
+#define TSG_ALL 15           /* every TSGprm value, for the disk copy */
+
+static struct SiteTimSeq seq[SITE_SEQ_MAX];
+static int smax=SITE_SEQ_MAX;
+static unsigned int tick=0;
+static char *sdir=NULL;
+
+static void PrmIn(struct TSGprm *prm,int32 *v) {
+  v[0]=prm->nrang;
+  v[1]=prm->frang;
+  v[2]=prm->rtoxmin;
+  v[3]=prm->stdelay;
+  v[4]=prm->gort;
+  v[5]=prm->rsep;
+  v[6]=prm->smsep;
+  v[7]=prm->txpl;
+  v[8]=prm->mpinc;
+  v[9]=prm->mppul;
+  v[10]=prm->mlag;
+  v[11]=prm->nbaud;
+}
+
+static void PrmPack(struct TSGprm *prm,int32 *v) {
+  PrmIn(prm,v);
+  v[12]=prm->lagfr;
+  v[13]=prm->samples;
+  v[14]=prm->smdelay;
+}
+
+static void PrmUnpack(struct TSGprm *prm,int32 *v) {
+  prm->nrang=v[0];
+  prm->frang=v[1];
+  prm->rtoxmin=v[2];
+  prm->stdelay=v[3];
+  prm->gort=v[4];
+  prm->rsep=v[5];
+  prm->smsep=v[6];
+  prm->txpl=v[7];
+  prm->mpinc=v[8];
+  prm->mppul=v[9];
+  prm->mlag=v[10];
+  prm->nbaud=v[11];
+  prm->lagfr=v[12];
+  prm->samples=v[13];
+  prm->smdelay=v[14];
+}
+
+/* FNV-1a over the parameters, the pulse table and the phase code */
+
+static uint32 Hash(uint32 h,void *ptr,int n) {
+  int i;
+  unsigned char *c=(unsigned char *) ptr;
+  for (i=0;i<n;i++) {
+    h^=c[i];
+    h*=16777619U;
+  }
+  return h;
+}
+
+uint32 SiteTimSeqHash(struct TSGprm *prm) {
+  uint32 h=2166136261U;
+  int32 v[TSG_IN];
+  PrmIn(prm,v);
+  h=Hash(h,v,sizeof(v));
+  if ((prm->pat !=NULL) && (prm->mppul>0))
+    h=Hash(h,prm->pat,sizeof(int)*prm->mppul);
+  if ((prm->code !=NULL) && (prm->nbaud>0))
+    h=Hash(h,prm->code,sizeof(int)*prm->nbaud);
+  if (h==0) h=1;
+  return h;
+}
+
+static int Same(struct TSGprm *a,struct TSGprm *b) {
+  int32 va[TSG_IN],vb[TSG_IN];
+  PrmIn(a,va);
+  PrmIn(b,vb);
+  if (memcmp(va,vb,sizeof(va)) !=0) return 0;
+  if ((a->pat==NULL) !=(b->pat==NULL)) return 0;
+  if ((a->code==NULL) !=(b->code==NULL)) return 0;
+  if ((a->pat !=NULL) && (a->mppul>0) &&
+      (memcmp(a->pat,b->pat,sizeof(int)*a->mppul) !=0)) return 0;
+  if ((a->code !=NULL) && (a->nbaud>0) &&
+      (memcmp(a->code,b->code,sizeof(int)*a->nbaud) !=0)) return 0;
+  return 1;
+}
+
+static void Clear(struct SiteTimSeq *ptr) {
+  if (ptr->buf !=NULL) TSGFree(ptr->buf);
+  if (ptr->in.pat !=NULL) free(ptr->in.pat);
+  if (ptr->in.code !=NULL) free(ptr->in.code);
+  memset(ptr,0,sizeof(struct SiteTimSeq));
+}
+
+void SiteTimSeqDrop(struct SiteTimSeq *ptr) {
+  if (ptr==NULL) return;
+  Clear(ptr);
+}
+
+/* Set the number of sequences held and the directory for the disk
+   copies, NULL for none. Sequences beyond the new limit are dropped. */
+
+void SiteTimSeqConfig(int max,char *dir) {
+  int i;
+  if (max<1) max=1;
+  if (max>SITE_SEQ_MAX) max=SITE_SEQ_MAX;
+  for (i=max;i<SITE_SEQ_MAX;i++) Clear(&seq[i]);
+  smax=max;
+  if (sdir !=NULL) free(sdir);
+  sdir=NULL;
+  if ((dir !=NULL) && (dir[0] !=0)) sdir=strdup(dir);
+}
+
+/* A new connection to the ROS holds none of the sequences */
+
+void SiteTimSeqReset() {
+  int i;
+  for (i=0;i<SITE_SEQ_MAX;i++) seq[i].reg=0;
+}
+
+struct SiteTimSeq *SiteTimSeqFind(struct TSGprm *prm) {
+  int i;
+  uint32 hash;
+  hash=SiteTimSeqHash(prm);
+  for (i=0;i<smax;i++) {
+    if (seq[i].hash !=hash) continue;
+    if (Same(&seq[i].in,prm)==0) continue;
+    seq[i].used=++tick;
+    return &seq[i];
+  }
+  return NULL;
+}
+
+static void FileName(char *name,int sze,uint32 hash) {
+  snprintf(name,sze,"%s/tsg.%08x",sdir,hash);
+}
+
+static int Load(struct SiteTimSeq *ptr) {
+  char name[1024];
+  FILE *fp;
+  int32 vin[TSG_ALL],v[TSG_ALL];
+  int32 magic=0,len=0,pnum=0,cnum=0;
+  int *pat=NULL,*code=NULL;
+  struct TSGprm tmp;
+  struct TSGbuf *buf=NULL;
+  struct stat st;
+  long pos;
+
+  FileName(name,sizeof(name),ptr->hash);
+  fp=fopen(name,"r");
+  if (fp==NULL) return -1;
+
+  if ((fread(&magic,sizeof(int32),1,fp) !=1) || (magic !=TSG_MAGIC))
+    goto fail;
+  if (fread(vin,sizeof(int32),TSG_ALL,fp) !=TSG_ALL) goto fail;
+  if (fread(v,sizeof(int32),TSG_ALL,fp) !=TSG_ALL) goto fail;
+  if (fread(&pnum,sizeof(int32),1,fp) !=1) goto fail;
+  if (fread(&cnum,sizeof(int32),1,fp) !=1) goto fail;
+  if ((pnum<0) || (pnum>vin[9]) || (cnum<0) || (cnum>vin[11])) goto fail;
+  if (pnum>0) {
+    pat=malloc(sizeof(int)*pnum);
+    if ((pat==NULL) || (fread(pat,sizeof(int),pnum,fp) !=(size_t) pnum))
+      goto fail;
+  }
+  if (cnum>0) {
+    code=malloc(sizeof(int)*cnum);
+    if ((code==NULL) || (fread(code,sizeof(int),cnum,fp) !=(size_t) cnum))
+      goto fail;
+  }
+
+  /* the file must be for exactly this sequence, not just the hash */
+  memset(&tmp,0,sizeof(struct TSGprm));
+  PrmUnpack(&tmp,vin);
+  tmp.pat=pat;
+  tmp.code=code;
+  if (Same(&tmp,&ptr->in)==0) goto fail;
+
+  if ((fread(&len,sizeof(int32),1,fp) !=1) || (len<=0)) goto fail;
+
+  /* Save ends the file with the two len byte tables, so anything else
+     is a damaged file and len is not trusted for the allocation */
+  if ((pos=ftell(fp))<0) goto fail;
+  if (fstat(fileno(fp),&st) !=0) goto fail;
+  if ((st.st_size-pos) !=2*(off_t) len) goto fail;
+
+  buf=malloc(sizeof(struct TSGbuf));
+  if (buf==NULL) goto fail;
+  memset(buf,0,sizeof(struct TSGbuf));
+  buf->len=len;
+  buf->rep=malloc(len);
+  buf->code=malloc(len);
+  if ((buf->rep==NULL) || (buf->code==NULL)) goto fail;
+  if (fread(buf->rep,1,len,fp) !=(size_t) len) goto fail;
+  if (fread(buf->code,1,len,fp) !=(size_t) len) goto fail;
+  fclose(fp);
+  free(pat);
+  free(code);
+
+  PrmUnpack(&ptr->prm,v);
+  ptr->buf=buf;
+  return 0;
+
+fail:
+  fclose(fp);
+  if (pat !=NULL) free(pat);
+  if (code !=NULL) free(code);
+  if (buf !=NULL) TSGFree(buf);
+  return -1;
+}
+
+static int Save(struct SiteTimSeq *ptr) {
+  char name[1024],tmp[1040];
+  FILE *fp;
+  int32 vin[TSG_ALL],v[TSG_ALL];
+  int32 magic=TSG_MAGIC,len,pnum=0,cnum=0;
+  int s=0;
+
+  FileName(name,sizeof(name),ptr->hash);
+  snprintf(tmp,sizeof(tmp),"%s.%d",name,(int) getpid());
+  fp=fopen(tmp,"w");
+  if (fp==NULL) return -1;
+
+  /* TSGMake can adjust the parameters, so both sets are kept */
+  PrmPack(&ptr->in,vin);
+  PrmPack(&ptr->prm,v);
+  if (ptr->in.pat !=NULL) pnum=ptr->in.mppul;
+  if (ptr->in.code !=NULL) cnum=ptr->in.nbaud;
+  len=ptr->buf->len;
+
+  if (fwrite(&magic,sizeof(int32),1,fp) !=1) s=-1;
+  if (fwrite(vin,sizeof(int32),TSG_ALL,fp) !=TSG_ALL) s=-1;
+  if (fwrite(v,sizeof(int32),TSG_ALL,fp) !=TSG_ALL) s=-1;
+  if (fwrite(&pnum,sizeof(int32),1,fp) !=1) s=-1;
+  if (fwrite(&cnum,sizeof(int32),1,fp) !=1) s=-1;
+  if ((pnum>0) && (fwrite(ptr->in.pat,sizeof(int),pnum,fp) !=(size_t) pnum))
+    s=-1;
+  if ((cnum>0) && (fwrite(ptr->in.code,sizeof(int),cnum,fp) !=(size_t) cnum))
+    s=-1;
+  if (fwrite(&len,sizeof(int32),1,fp) !=1) s=-1;
+  if (fwrite(ptr->buf->rep,1,len,fp) !=(size_t) len) s=-1;
+  if (fwrite(ptr->buf->code,1,len,fp) !=(size_t) len) s=-1;
+  if (fclose(fp) !=0) s=-1;
+
+  /* only a complete file is ever seen under the real name */
+  if ((s==0) && (rename(tmp,name)==0)) return 0;
+  unlink(tmp);
+  return -1;
+}
+
+/* Make a sequence and give it a slot, either a free one or the one
+   selected longest ago. The caller registers it with the ROS. */
+
+struct SiteTimSeq *SiteTimSeqMake(struct TSGprm *prm) {
+  int i,flag;
+  struct SiteTimSeq *ptr=NULL;
+
+  for (i=0;i<smax;i++) {
+    if (seq[i].hash==0) {
+      ptr=&seq[i];
+      break;
+    }
+    if ((ptr==NULL) || (seq[i].used<ptr->used)) ptr=&seq[i];
+  }
+  Clear(ptr);
+  ptr->index=ptr-seq;
+
+  ptr->in=*prm;
+  ptr->in.pat=NULL;
+  ptr->in.code=NULL;
+  if ((prm->pat !=NULL) && (prm->mppul>0)) {
+    ptr->in.pat=malloc(sizeof(int)*prm->mppul);
+    if (ptr->in.pat==NULL) goto fail;
+    memcpy(ptr->in.pat,prm->pat,sizeof(int)*prm->mppul);
+  }
+  if ((prm->code !=NULL) && (prm->nbaud>0)) {
+    ptr->in.code=malloc(sizeof(int)*prm->nbaud);
+    if (ptr->in.code==NULL) goto fail;
+    memcpy(ptr->in.code,prm->code,sizeof(int)*prm->nbaud);
+  }
+  ptr->hash=SiteTimSeqHash(&ptr->in);
+  ptr->prm=ptr->in;
+
+  if ((sdir==NULL) || (Load(ptr) !=0)) {
+    ptr->buf=TSGMake(&ptr->prm,&flag);
+    if (ptr->buf==NULL) goto fail;
+    if ((sdir !=NULL) && (Save(ptr) !=0))
+      fprintf(stderr,"SiteTimSeqMake: cannot write sequence to %s\n",sdir);
+  }
+  ptr->prm.pat=ptr->in.pat;
+  ptr->prm.code=ptr->in.code;
+  ptr->used=++tick;
+  return ptr;
+
+fail:
+  Clear(ptr);
+  return NULL;
+}
@@ -0,0 +1,28 @@
+/* sitetsg.h
+   =========
+*/
+
+
+#ifndef _SITETSG_H
+#define _SITETSG_H
+
+#define SITE_SEQ_MAX 8 /* sequences held on the ROS at once */
+
+struct SiteTimSeq {
+  uint32 hash;        /* hash of the sequence parameters, 0 for a free slot */
+  int index;          /* sequence index on the ROS */
+  int reg;            /* registered with the ROS on this connection */
+  unsigned int used;  /* last selection, for replacement */
+  struct TSGprm in;   /* parameters the sequence was made from */
+  struct TSGprm prm;  /* the same after TSGMake, shares pat and code */
+  struct TSGbuf *buf;
+};
+
+void SiteTimSeqConfig(int max,char *dir);
+void SiteTimSeqReset();
+uint32 SiteTimSeqHash(struct TSGprm *prm);
+struct SiteTimSeq *SiteTimSeqFind(struct TSGprm *prm);
+struct SiteTimSeq *SiteTimSeqMake(struct TSGprm *prm);
+void SiteTimSeqDrop(struct SiteTimSeq *ptr);
+
+#endif
@@ -0,0 +1,681 @@
+/* rosstub.c
+   =========
+*/
+/*
+ $License$
+*/
+
+/* Stand-in ROS for exercising the site library without a radar.
+ *
+ * It answers the control messages the library sends with fixed values
+ * and makes up the samples of each sequence, so a control program can
+ * be run against it on any machine. Only one control program is served
+ * at a time.
+ *
+ * The protocol extensions can be switched on or left off, so both the
+ * new and the old paths of the library can be driven:
+ *
+ *   --wait      answer site_settings:wait_for_data, without it the
+ *               library falls back to sleeping for each sequence
+ *   --late n    the samples come n us after the sequence should have
+ *               ended, more than the wait slack gives a WAIT_FOR_DATA
+ *               reply with status 0
+ *   --status    answer site_settings:data_status
+ *
+ * It listens on TCP and, with --unix, on a unix socket as well. With
+ * --shm it answers site_settings:shm_samples, makes the sample ring and
+ * puts the samples there; --badmagic makes a ring the library must
+ * refuse, so that it starts again over the unix socket.
+ *
+ * With --datachan it hands out a data channel and sends the bulk part
+ * of each data reply on it. --sync then holds the stub until the
+ * library has read the bulk part, as a ROS writing it out in full
+ * would be: with --sync 1 the hold comes straight after the bulk part,
+ * ahead of the rest of the reply; with --sync 2 it comes after the
+ * whole reply, so the next request waits on it. The stub can only tell
+ * that the bulk part has been read over a unix socket, so --sync needs
+ * the unix transport. A library that does not read it in time is
+ * counted as stuck.
+ *
+ * The counts printed when the control program quits say which paths
+ * were taken.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <argtable2.h>
+#include "rtypes.h"
+#include "rosmsg.h"
+#include "tcpipmsg.h"
+#include "sitemsg.h"
+#include "sitelink.h"
+
+#define STUB_CONN 8
+#define STUB_NTX 16
+#define STUB_BADTR 4
+#define STUB_HDRSZE 64
+#define STUB_SLOTSMP 16384 /* samples a ring slot holds */
+
+struct StubConn {
+  int fd;
+  int rnum,cnum;
+  int status;           /* data status switched on */
+  int waitdata;         /* WAIT_FOR_DATA switched on */
+  int ring;             /* samples go in the ring */
+  char *link;           /* transport the connection came in on */
+  int32 token;          /* data channel token handed out */
+  int dfd;              /* data channel bound to this connection */
+  int data;             /* this connection is a data channel */
+  struct ControlPRM prm;
+  struct timeval ready; /* when the armed sequence's samples are in */
+  int armed;
+  uint32 seq;
+};
+
+struct StubCount {
+  int seq;
+  int wait;
+  int late;
+  int ring;
+  int held;             /* slots written before the library was done */
+  int stuck;            /* bulk parts not read in time */
+} count;
+
+struct StubConn conn[STUB_CONN];
+int debug=0;
+int wait_on=0;
+int status_on=0;
+int late=0;
+int quit=0;
+int shm_on=0;
+int badmagic=0;
+int slots=4;
+int datachan_on=0;
+int sync_on=0;
+int32 ntoken=0;
+
+struct SiteTimLinkRing *ring=NULL;
+char ringname[64];
+size_t ringsze=0;
+
+uint32 *smp=NULL;
+int smpmax=0;
+
+static double TimeDiff(struct timeval *a,struct timeval *b) {
+  return (a->tv_sec-b->tv_sec)+(a->tv_usec-b->tv_usec)/1.0e6;
+}
+
+static void TimeAdd(struct timeval *t,int usec) {
+  t->tv_sec+=usec/1000000;
+  t->tv_usec+=usec % 1000000;
+  if (t->tv_usec>=1000000) {
+    t->tv_sec++;
+    t->tv_usec-=1000000;
+  }
+}
+
+/* sleep until t, or for at most usec if that comes first; returns
+   non-zero if t was reached */
+
+static int SleepUntil(struct timeval *t,int usec) {
+  struct timeval now,end;
+  double dt;
+  gettimeofday(&now,NULL);
+  end=now;
+  if (usec>=0) TimeAdd(&end,usec);
+  if ((usec>=0) && (TimeDiff(&end,t)<0)) {
+    dt=TimeDiff(&end,&now);
+    if (dt>0) usleep(dt*1e6);
+    return 0;
+  }
+  dt=TimeDiff(t,&now);
+  if (dt>0) usleep(dt*1e6);
+  return 1;
+}
+
+static int Reply(int fd,char type,int32 status) {
+  struct ROSMsg msg;
+  memset(&msg,0,sizeof(msg));
+  msg.type=type;
+  msg.status=status;
+  if (TCPIPMsgSend(fd,&msg,sizeof(struct ROSMsg)) !=sizeof(struct ROSMsg))
+    return -1;
+  return 0;
+}
+
+static int Listen(int port) {
+  int fd,on=1;
+  struct sockaddr_in addr;
+  fd=socket(AF_INET,SOCK_STREAM,0);
+  if (fd<0) return -1;
+  setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+  memset(&addr,0,sizeof(addr));
+  addr.sin_family=AF_INET;
+  addr.sin_port=htons(port);
+  addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+  if ((bind(fd,(struct sockaddr *) &addr,sizeof(addr)) !=0) ||
+      (listen(fd,4) !=0)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int ListenUnix(char *path) {
+  int fd;
+  struct sockaddr_un addr;
+  if (strlen(path)>=sizeof(addr.sun_path)) return -1;
+  fd=socket(AF_UNIX,SOCK_STREAM,0);
+  if (fd<0) return -1;
+  unlink(path);
+  memset(&addr,0,sizeof(addr));
+  addr.sun_family=AF_UNIX;
+  strcpy(addr.sun_path,path);
+  if ((bind(fd,(struct sockaddr *) &addr,sizeof(addr)) !=0) ||
+      (listen(fd,4) !=0)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Make the sample ring the library maps for the shm transport */
+
+static int RingMake(int rnum,int cnum) {
+  int fd;
+  if (ring !=NULL) munmap(ring,ringsze);
+  if (ringname[0] !=0) shm_unlink(ringname);
+  ring=NULL;
+  sprintf(ringname,SITELINK_NAME,rnum,cnum);
+  ringsze=STUB_HDRSZE+(size_t) slots*2*sizeof(uint32)*STUB_SLOTSMP;
+  fd=shm_open(ringname,O_RDWR | O_CREAT,0600);
+  if (fd<0) return -1;
+  if (ftruncate(fd,ringsze) !=0) {
+    close(fd);
+    return -1;
+  }
+  ring=mmap(NULL,ringsze,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+  close(fd);
+  if (ring==MAP_FAILED) {
+    ring=NULL;
+    return -1;
+  }
+  ring->magic=(badmagic) ? 0 : SITELINK_MAGIC;
+  ring->slots=slots;
+  ring->slotsze=2*sizeof(uint32)*STUB_SLOTSMP;
+  ring->hdrsze=STUB_HDRSZE;
+  __atomic_store_n(&ring->done,0,__ATOMIC_RELEASE);
+  return 0;
+}
+
+/* The slot for sequence seq once the library is done with the one in
+   it. A library that never gives it back is not waited on for ever. */
+
+static uint32 *RingSlot(uint32 seq) {
+  int i;
+  for (i=0;i<2000;i++) {
+    if (__atomic_load_n(&ring->done,__ATOMIC_ACQUIRE)+ring->slots>seq) break;
+    usleep(1000);
+  }
+  if (i==2000) count.held++;
+  return (uint32 *) ((char *) ring+ring->hdrsze+
+                     (size_t) (seq % ring->slots)*ring->slotsze);
+}
+
+static void Close(struct StubConn *c) {
+  int i;
+  if (c->fd<=0) return;
+  for (i=0;i<STUB_CONN;i++) {
+    if (conn[i].fd<=0) continue;
+    if ((c->data) && (conn[i].dfd==c->fd)) conn[i].dfd=0;
+    if ((c->dfd>0) && (conn[i].fd==c->dfd)) {
+      close(conn[i].fd);
+      memset(&conn[i],0,sizeof(struct StubConn));
+    }
+  }
+  close(c->fd);
+  memset(c,0,sizeof(struct StubConn));
+}
+
+/* Bind a new connection to the control connection that was handed the
+   token */
+
+static int DataChannel(struct StubConn *c) {
+  int32 temp32[3];
+  int i;
+  if (TCPIPMsgRecv(c->fd,temp32,sizeof(temp32)) !=sizeof(temp32)) return -1;
+  for (i=0;i<STUB_CONN;i++) {
+    if ((conn[i].fd<=0) || (conn[i].data) || (conn[i].token==0)) continue;
+    if ((conn[i].token==temp32[2]) && (conn[i].rnum==temp32[0]) &&
+        (conn[i].cnum==temp32[1])) break;
+  }
+  if (i==STUB_CONN) {
+    Reply(c->fd,DATA_CHANNEL,0);
+    return -1;
+  }
+  conn[i].dfd=c->fd;
+  c->data=1;
+  fprintf(stderr,"rosstub: data channel on %s\n",c->link);
+  return Reply(c->fd,DATA_CHANNEL,1);
+}
+
+/* Hold until the library has read everything sent on fd, as a ROS
+   writing through a buffer too small for the bulk part would be */
+
+static void Drain(int fd) {
+  int i,q=0;
+  for (i=0;i<5000;i++) {
+    if ((ioctl(fd,SIOCOUTQ,&q) !=0) || (q==0)) return;
+    usleep(1000);
+  }
+  count.stuck++;
+  fprintf(stderr,"rosstub: bulk part not read after 5 s\n");
+}
+
+/* Make up the samples of one sequence, a weak tone on top of a small
+   offset that changes with the sequence number */
+
+static void Samples(uint32 *buf,int n,uint32 seq) {
+  int i;
+  int16 iv,qv;
+  for (i=0;i<n;i++) {
+    iv=(int16) (((i*7+seq*13) % 61)-30);
+    qv=(int16) (((i*11+seq*5) % 53)-26);
+    buf[i]=((uint32) (uint16) qv<<16) | (uint16) iv;
+  }
+}
+
+static int QueryIni(struct StubConn *c) {
+  int32 len,value=0,tlen;
+  char name[256];
+  char type,rtype;
+  int known=0;
+
+  if (TCPIPMsgRecv(c->fd,&len,sizeof(int32)) !=sizeof(int32)) return -1;
+  if ((len<=0) || (len>(int32) sizeof(name))) return -1;
+  if (TCPIPMsgRecv(c->fd,name,len) !=len) return -1;
+  name[len-1]=0;
+  if (TCPIPMsgRecv(c->fd,&type,sizeof(char)) !=sizeof(char)) return -1;
+
+  if (strcmp(name,"site_settings:ifmode")==0) {
+    value=0;
+    known=1;
+  } else if ((strcmp(name,SITEMSG_DATA_STATUS)==0) && (status_on)) {
+    value=1;
+    known=1;
+    c->status=1;
+  } else if ((strcmp(name,SITEMSG_WAIT_FOR_DATA)==0) && (wait_on)) {
+    value=1;
+    known=1;
+    c->waitdata=1;
+  } else if ((strcmp(name,SITEMSG_DATA_CHANNEL)==0) && (datachan_on)) {
+    c->token=(getpid() & 0xffff)*1000+(++ntoken % 1000);
+    value=c->token;
+    known=1;
+  } else if ((strcmp(name,SITELINK_SHM_SAMPLES)==0) && (shm_on) &&
+             (RingMake(c->rnum,c->cnum)==0)) {
+    value=1;
+    known=1;
+    c->ring=1;
+  }
+  if (debug) fprintf(stderr,"rosstub: ini %s %s\n",name,
+                     (known) ? "known" : "unknown");
+
+  /* an unknown entry comes back with no type and no value */
+  rtype=(known) ? type : ' ';
+  tlen=(known) ? sizeof(int32) : 0;
+  TCPIPMsgSend(c->fd,&rtype,sizeof(char));
+  TCPIPMsgSend(c->fd,&tlen,sizeof(int32));
+  if (known) TCPIPMsgSend(c->fd,&value,sizeof(int32));
+  return Reply(c->fd,QUERY_INI_SETTINGS,known);
+}
+
+static int RegisterSeq(struct StubConn *c) {
+  struct SeqPRM prm;
+  unsigned char *buf=NULL;
+  int32 *ibuf=NULL;
+  int s=0;
+
+  if (TCPIPMsgRecv(c->fd,&prm,sizeof(struct SeqPRM)) !=
+      sizeof(struct SeqPRM)) return -1;
+  buf=malloc(prm.len+1);
+  ibuf=malloc(sizeof(int32)*(prm.mppul+prm.nbaud+1));
+  if ((buf==NULL) || (ibuf==NULL)) s=-1;
+  if ((s==0) && (TCPIPMsgRecv(c->fd,buf,prm.len) !=(int) prm.len)) s=-1;
+  if ((s==0) && (TCPIPMsgRecv(c->fd,buf,prm.len) !=(int) prm.len)) s=-1;
+  if ((s==0) && (TCPIPMsgRecv(c->fd,ibuf,sizeof(int32)*prm.mppul) !=
+                 (int) (sizeof(int32)*prm.mppul))) s=-1;
+  if ((s==0) && (TCPIPMsgRecv(c->fd,ibuf,sizeof(int32)*prm.nbaud) !=
+                 (int) (sizeof(int32)*prm.nbaud))) s=-1;
+  free(buf);
+  free(ibuf);
+  if (s !=0) return -1;
+  if (debug) fprintf(stderr,"rosstub: sequence %d len %d\n",prm.index,
+                     prm.len);
+  return Reply(c->fd,REGISTER_SEQ,1);
+}
+
+/* the length of the armed sequence in usec, worked out the same way
+   as the library does */
+
+static int SeqTime(struct StubConn *c) {
+  if (c->prm.baseband_samplerate<=0) return 0;
+  return (int) (c->prm.number_of_samples/c->prm.baseband_samplerate*1E6);
+}
+
+static int WaitForData(struct StubConn *c) {
+  int32 usec;
+  int ok;
+  if (TCPIPMsgRecv(c->fd,&usec,sizeof(int32)) !=sizeof(int32)) return -1;
+  count.wait++;
+  ok=SleepUntil(&c->ready,usec);
+  if (ok==0) count.late++;
+  return Reply(c->fd,WAIT_FOR_DATA,ok);
+}
+
+static int GetData(struct StubConn *c) {
+  struct DataPRM dprm;
+  struct SiteTimDataStatus dstat;
+  struct timeval now;
+  int32 ntx=STUB_NTX,badtr=STUB_BADTR;
+  int32 agc[STUB_NTX],lowpwr[STUB_NTX];
+  uint32 start[STUB_BADTR],duration[STUB_BADTR];
+  uint32 *slot=NULL;
+  int bfd=(c->dfd>0) ? c->dfd : c->fd;
+  int i,n;
+
+  memset(&dprm,0,sizeof(struct DataPRM));
+  if (c->armed==0) {
+    /* nothing was asked for */
+    dprm.status=-1;
+    TCPIPMsgSend(c->fd,&dprm,sizeof(struct DataPRM));
+  } else {
+    SleepUntil(&c->ready,-1);
+    gettimeofday(&now,NULL);
+    n=c->prm.number_of_samples;
+    if ((c->ring) && (n>STUB_SLOTSMP)) {
+      fprintf(stderr,"rosstub: %d samples do not fit a ring slot\n",n);
+      return -1;
+    }
+    if (n>smpmax) {
+      free(smp);
+      smp=malloc(2*sizeof(uint32)*n);
+      if (smp==NULL) {
+        smpmax=0;
+        return -1;
+      }
+      smpmax=n;
+    }
+    dprm.event_secs=now.tv_sec;
+    dprm.event_nsecs=now.tv_usec*1000;
+    dprm.samples=n;
+    dprm.status=0;
+    TCPIPMsgSend(c->fd,&dprm,sizeof(struct DataPRM));
+
+    for (i=0;i<badtr;i++) {
+      start[i]=i*c->prm.number_of_samples;
+      duration[i]=300;
+    }
+    if (c->ring) {
+      /* the samples go in the slot and only its number in the reply */
+      slot=RingSlot(c->seq);
+      Samples(slot,2*n,c->seq);
+      TCPIPMsgSend(c->fd,&c->seq,sizeof(uint32));
+      count.ring++;
+    } else {
+      Samples(smp,2*n,c->seq);
+      TCPIPMsgSend(bfd,smp,sizeof(uint32)*n);
+      TCPIPMsgSend(bfd,smp+n,sizeof(uint32)*n);
+    }
+    TCPIPMsgSend(bfd,&badtr,sizeof(int32));
+    TCPIPMsgSend(bfd,start,sizeof(uint32)*badtr);
+    TCPIPMsgSend(bfd,duration,sizeof(uint32)*badtr);
+    if ((sync_on==1) && (c->dfd>0)) Drain(c->dfd);
+
+    for (i=0;i<ntx;i++) {
+      agc[i]=1;
+      lowpwr[i]=0;
+    }
+    TCPIPMsgSend(c->fd,&ntx,sizeof(int32));
+    TCPIPMsgSend(c->fd,agc,sizeof(int32)*ntx);
+    TCPIPMsgSend(c->fd,lowpwr,sizeof(int32)*ntx);
+    c->armed=0;
+    c->seq++;
+    count.seq++;
+  }
+  if (c->status) {
+    dstat.tbeam=c->prm.tbeam;
+    dstat.tfreq=c->prm.tfreq;
+    dstat.rfreq=c->prm.rfreq;
+    dstat.status=c->prm.status;
+    TCPIPMsgSend(c->fd,&dstat,sizeof(struct SiteTimDataStatus));
+  }
+  if (Reply(c->fd,GET_DATA,1) !=0) return -1;
+  if ((sync_on==2) && (c->dfd>0)) Drain(c->dfd);
+  return 0;
+}
+
+/* Handle one message from the control program, returns -1 once the
+   connection is finished with */
+
+static int Message(struct StubConn *c) {
+  struct ROSMsg msg;
+  struct CLRFreqPRM fprm;
+  int32 temp32[2];
+  int32 tfreq;
+  float noise=1.0;
+
+  if (TCPIPMsgRecv(c->fd,&msg,sizeof(struct ROSMsg)) !=
+      sizeof(struct ROSMsg)) return -1;
+  if (debug) fprintf(stderr,"rosstub: message %c\n",msg.type);
+
+  /* nothing more is asked for on a data channel */
+  if (c->data) return -1;
+
+  switch (msg.type) {
+  case DATA_CHANNEL:
+    return DataChannel(c);
+  case SET_RADAR_CHAN:
+    if (TCPIPMsgRecv(c->fd,temp32,2*sizeof(int32)) !=2*sizeof(int32))
+      return -1;
+    c->rnum=temp32[0];
+    c->cnum=temp32[1];
+    c->prm.radar=c->rnum;
+    c->prm.channel=c->cnum;
+    c->prm.tfreq=12000;
+    c->prm.rfreq=12000;
+    return Reply(c->fd,msg.type,0);
+  case QUERY_INI_SETTINGS:
+    return QueryIni(c);
+  case GET_PARAMETERS:
+    /* like the ROS, report a status of its own rather than echoing
+       back exactly what was set */
+    c->prm.status=c->seq;
+    TCPIPMsgSend(c->fd,&c->prm,sizeof(struct ControlPRM));
+    return Reply(c->fd,msg.type,1);
+  case SET_PARAMETERS:
+    if (TCPIPMsgRecv(c->fd,&c->prm,sizeof(struct ControlPRM)) !=
+        sizeof(struct ControlPRM)) return -1;
+    return Reply(c->fd,msg.type,1);
+  case REGISTER_SEQ:
+    return RegisterSeq(c);
+  case SET_READY_FLAG:
+    gettimeofday(&c->ready,NULL);
+    TimeAdd(&c->ready,SeqTime(c)+late);
+    c->armed=1;
+    return Reply(c->fd,msg.type,1);
+  case WAIT_FOR_DATA:
+    return WaitForData(c);
+  case GET_DATA:
+    return GetData(c);
+  case REQUEST_CLEAR_FREQ_SEARCH:
+    if (TCPIPMsgRecv(c->fd,&fprm,sizeof(struct CLRFreqPRM)) !=
+        sizeof(struct CLRFreqPRM)) return -1;
+    c->prm.tfreq=(fprm.start+fprm.end)/2;
+    return Reply(c->fd,msg.type,1);
+  case REQUEST_ASSIGNED_FREQ:
+    tfreq=c->prm.tfreq;
+    TCPIPMsgSend(c->fd,&tfreq,sizeof(int32));
+    TCPIPMsgSend(c->fd,&noise,sizeof(float));
+    return Reply(c->fd,msg.type,1);
+  case QUIT:
+    Reply(c->fd,msg.type,1);
+    quit++;
+    return -1;
+  case PING:
+  case SET_ACTIVE:
+  case SET_INACTIVE:
+    return Reply(c->fd,msg.type,1);
+  default:
+    fprintf(stderr,"rosstub: unknown message %c\n",msg.type);
+    return Reply(c->fd,msg.type,-1);
+  }
+  return 0;
+}
+
+int main(int argc,char *argv[]) {
+  struct arg_lit *al_help=arg_lit0(NULL,"help","Prints help information and then exits");
+  struct arg_lit *al_debug=arg_lit0(NULL,"debug","Print each message");
+  struct arg_lit *al_once=arg_lit0(NULL,"once","Exit once the control program has gone");
+  struct arg_lit *al_wait=arg_lit0(NULL,"wait","Support WAIT_FOR_DATA");
+  struct arg_lit *al_status=arg_lit0(NULL,"status","Send the data status with each data reply");
+  struct arg_int *ai_port=arg_int0(NULL,"port",NULL,"TCP port to listen on, default 45000");
+  struct arg_int *ai_late=arg_int0(NULL,"late",NULL,"Samples arrive this many us after the sequence");
+  struct arg_str *as_unix=arg_str0(NULL,"unix",NULL,"Also listen on this unix socket");
+  struct arg_lit *al_shm=arg_lit0(NULL,"shm","Put the samples in the shared memory ring");
+  struct arg_lit *al_badmagic=arg_lit0(NULL,"badmagic","Make a ring the library must refuse");
+  struct arg_int *ai_slots=arg_int0(NULL,"slots",NULL,"Slots in the ring, default 4");
+  struct arg_lit *al_datachan=arg_lit0(NULL,"datachan","Hand out a data channel for the bulk part");
+  struct arg_int *ai_sync=arg_int0(NULL,"sync",NULL,"Hold until the bulk part is read, 1 before or 2 after the rest of the reply");
+  struct arg_end *ae_argend=arg_end(20);
+  void *argtable[]={al_help,al_debug,al_once,al_wait,al_status,ai_port,
+                    ai_late,as_unix,al_shm,al_badmagic,ai_slots,
+                    al_datachan,ai_sync,ae_argend};
+
+  int port=45000;
+  int once=0;
+  char path[256]="";
+  int lfd[2]={-1,-1};
+  int nerrors,i,j,n;
+  struct pollfd pfd[STUB_CONN+2];
+
+  if (arg_nullcheck(argtable) !=0) {
+    fprintf(stderr,"rosstub: insufficient memory\n");
+    exit(1);
+  }
+  nerrors=arg_parse(argc,argv,argtable);
+  if (nerrors>0) {
+    arg_print_errors(stdout,ae_argend,"rosstub");
+    exit(1);
+  }
+  if (al_help->count>0) {
+    printf("ROSSTUB: Stand-in ROS for the site library.\n\n");
+    printf(" Usage: rosstub");
+    arg_print_syntax(stdout,argtable,"\n");
+    arg_print_glossary(stdout,argtable,"  %-25s %s\n");
+    arg_freetable(argtable,sizeof(argtable)/sizeof(argtable[0]));
+    return 0;
+  }
+  debug=al_debug->count;
+  once=al_once->count;
+  wait_on=al_wait->count;
+  status_on=al_status->count;
+  if (ai_port->count) port=ai_port->ival[0];
+  if (ai_late->count) late=ai_late->ival[0];
+  if (as_unix->count) snprintf(path,sizeof(path),"%s",as_unix->sval[0]);
+  shm_on=al_shm->count;
+  badmagic=al_badmagic->count;
+  if (ai_slots->count) slots=ai_slots->ival[0];
+  if (slots<1) slots=1;
+  datachan_on=al_datachan->count;
+  if (ai_sync->count) sync_on=ai_sync->ival[0];
+  arg_freetable(argtable,sizeof(argtable)/sizeof(argtable[0]));
+
+  signal(SIGPIPE,SIG_IGN);
+  memset(conn,0,sizeof(conn));
+  lfd[0]=Listen(port);
+  if (lfd[0]<0) {
+    fprintf(stderr,"rosstub: cannot listen on port %d\n",port);
+    exit(1);
+  }
+  if ((path[0] !=0) && ((lfd[1]=ListenUnix(path))<0)) {
+    fprintf(stderr,"rosstub: cannot listen on %s\n",path);
+    exit(1);
+  }
+  fprintf(stderr,"rosstub: port %d wait %s late %d us data status %s\n",
+          port,(wait_on) ? "on" : "off",late,(status_on) ? "on" : "off");
+  fprintf(stderr,"rosstub: unix socket %s sample ring %s\n",
+          (path[0] !=0) ? path : "off",
+          (shm_on==0) ? "off" : ((badmagic) ? "bad magic" : "on"));
+  fprintf(stderr,"rosstub: data channel %s sync %d\n",
+          (datachan_on) ? "on" : "off",sync_on);
+
+  while (1) {
+    for (j=0;j<2;j++) {
+      pfd[j].fd=lfd[j];
+      pfd[j].events=POLLIN;
+      pfd[j].revents=0;
+    }
+    for (i=0;i<STUB_CONN;i++) {
+      pfd[i+2].fd=(conn[i].fd>0) ? conn[i].fd : -1;
+      pfd[i+2].events=POLLIN;
+      pfd[i+2].revents=0;
+    }
+    n=poll(pfd,STUB_CONN+2,-1);
+    if ((n<0) && (errno==EINTR)) continue;
+    if (n<0) break;
+
+    for (j=0;j<2;j++) {
+      if ((pfd[j].revents & POLLIN)==0) continue;
+      for (i=0;i<STUB_CONN;i++) if (conn[i].fd<=0) break;
+      n=accept(lfd[j],NULL,NULL);
+      if ((n>=0) && (i==STUB_CONN)) close(n);
+      else if (n>=0) {
+        memset(&conn[i],0,sizeof(struct StubConn));
+        conn[i].fd=n;
+        conn[i].link=(j==0) ? "tcp" : "unix";
+        fprintf(stderr,"rosstub: connection on %s\n",conn[i].link);
+      }
+    }
+
+    for (i=0;i<STUB_CONN;i++) {
+      if (pfd[i+2].revents==0) continue;
+      if (conn[i].fd<=0) continue;
+      if (Message(&conn[i])==0) continue;
+      if (conn[i].data==0) 
+        fprintf(stderr,"rosstub: %s closed, %d sequences %d waits %d late "
+                "%d in the ring %d held %d stuck\n",conn[i].link,count.seq,
+                count.wait,count.late,count.ring,count.held,count.stuck);
+      Close(&conn[i]);
+    }
+
+    /* the library reconnects at times, so only a quit ends the run */
+    if ((once) && (quit)) {
+      for (i=0;i<STUB_CONN;i++) if (conn[i].fd>0) break;
+      if (i==STUB_CONN) break;
+    }
+  }
+  close(lfd[0]);
+  if (lfd[1]>=0) {
+    close(lfd[1]);
+    unlink(path);
+  }
+  if (ringname[0] !=0) shm_unlink(ringname);
+  return 0;
+}
@@ -145,6 +145,13 @@ int main(int argc,char *argv[]) {
     { 0, 1},		/*  1 */
     { 9, 9}};		/* alternate lag-0  */
 
+/* Lag table for the power-only mode: lag-0 and its alternate only */
+  int pwrlags[LAG_SIZE][2] = {
+    { 0, 0},		/*  0 */
+    { 9, 9}};		/* alternate lag-0  */
+  int (*lagtab)[2]=lags;
+  int pwronly=0;
+
 /* Integration period variables */
   int scnsc=180;
   int scnus=0;
@@ -171,6 +178,8 @@ int main(int argc,char *argv[]) {
   struct arg_lit  *al_nowait     = arg_lit0(NULL, "nowait","Do not wait for minute scan boundary"); 
   struct arg_lit  *al_onesec     = arg_lit0(NULL, "onesec","Use one second integration times"); 
   struct arg_lit  *al_clrscan    = arg_lit0(NULL, "clrscan","Force clear frequency search at start of scan"); 
+  struct arg_lit  *al_pwronly    = arg_lit0(NULL, "pwronly","With --onesec or --fast, integrate lag-0 power only and skip XCF and FitACF"); 
+  struct arg_lit  *al_lag1       = arg_lit0(NULL, "lag1","With --pwronly, also keep lag-1 for the phase"); 
   /* Now lets define the integer valued arguments */
   struct arg_int  *ai_baud       = arg_int0(NULL, "baud", NULL,"Baud to use for phasecoded sequences"); /*OptionAdd( &opt, "baud", 'i', &nbaud);*/
   struct arg_int  *ai_tau        = arg_int0(NULL, "tau", NULL,"Lag spacing in usecs"); /*OptionAdd( &opt, "tau", 'i', &mpinc);*/
@@ -209,7 +218,8 @@ int main(int argc,char *argv[]) {
   /* create list of all arguement structs */
   void* argtable[] = {al_help,al_debug,al_test,al_discretion, al_fast, al_nowait, al_onesec, \
                       ai_baud, ai_tau, ai_nrang, ai_frang, ai_rsep, ai_dt, ai_nt, ai_df, ai_nf, ai_fixfrq, ai_xcf, ai_ep, ai_sp, ai_bp, ai_sb, ai_eb, ai_camp, ai_cnum, \
-                      as_ros, as_ststr, as_libstr,as_verstr,as_beampattern, ai_clrskip,al_clrscan,ai_cpid, ai_meribm, ai_eastbm, ai_westbm, ae_argend};
+                      as_ros, as_ststr, as_libstr,as_verstr,as_beampattern, ai_clrskip,al_clrscan,ai_cpid, ai_meribm, ai_eastbm, ai_westbm, \
+                      al_pwronly, al_lag1, ae_argend};
 
 /* END of variable defines */
 
@@ -231,6 +241,8 @@ int main(int argc,char *argv[]) {
   al_nowait->count = 1;
   al_onesec->count = 0;
   al_clrscan->count = 0;
+  al_pwronly->count = 0;
+  al_lag1->count = 0;
   al_debug->count = 0;
   ai_bp->ival[0] = 44100;
   ai_fixfrq->ival[0] = 10500;
@@ -363,6 +375,22 @@ int main(int argc,char *argv[]) {
   if (ai_eb->count) ebm = ai_eb->ival[0];
   if (ai_bp->count) baseport=ai_bp->ival[0];
 
+  /* Power-only mode for the high cadence scans: integrate lag-0 power
+     (and lag-1 if asked for) with no XCF, and skip FitACF. */
+  if ((al_pwronly->count) && ((al_onesec->count) || (al_fast->count))) {
+    pwronly=1;
+    xcnt=0;
+    if (al_lag1->count) {
+      mplgs=2;
+      lagtab=lags;
+    } else {
+      mplgs=1;
+      lagtab=pwrlags;
+    }
+  } else if (al_pwronly->count) {
+    fprintf(stderr,"--pwronly needs --onesec or --fast, ignored\n");
+  }
+
  for (iBeam =0; iBeam < nBeams_per_scan; iBeam++){
          scan_beam_number_list[iBeam] = current_beam;
          current_beam += backward ? -1:1;
@@ -497,6 +525,7 @@ int main(int argc,char *argv[]) {
     fprintf(stdout,"  xcf arg:: count: %d value: %d xcnt: %d\n",ai_xcf->count,ai_xcf->ival[0],xcnt);
     fprintf(stdout,"  baud arg:: count: %d value: %d nbaud: %d\n",ai_baud->count,ai_baud->ival[0],nbaud);
     fprintf(stdout,"  clrskip arg:: count: %d value: %d\n",ai_clrskip->count,ai_clrskip->ival[0]);
+    fprintf(stdout,"  pwronly: %d mplgs: %d\n",pwronly,mplgs);
     fprintf(stdout,"  cpid: %d progname: \'%s\'\n",cp,progname);
     fprintf(stdout,"Scan Sequence Parameters::\n");
     fprintf(stdout,"  txpl: %d mpinc: %d nbaud: %d rsep: %d\n",txpl,mpinc,nbaud,rsep);
@@ -568,8 +597,10 @@ int main(int argc,char *argv[]) {
     exit (1);
   }
 
-  printf("Preparing OpsFitACFStart Station ID: %s  %d\n",ststr,stid);
-  OpsFitACFStart();
+  if (pwronly==0) {
+    printf("Preparing OpsFitACFStart Station ID: %s  %d\n",ststr,stid);
+    OpsFitACFStart();
+  }
 
 
   printf("Preparing SiteTimeSeq Station ID: %s  %d\n",ststr,stid);
@@ -679,7 +710,7 @@ int main(int argc,char *argv[]) {
       sprintf(logtxt,"Transmitting on: %d (Noise=%g)",tfreq,noise);
       ErrLog(errlog.sock,progname,logtxt);
     
-      nave=SiteIntegrate(lags);   
+      nave=SiteIntegrate(lagtab);   
       if (nave<0) {
         sprintf(logtxt,"Integration error:%d",nave);
         ErrLog(errlog.sock,progname,logtxt); 
@@ -689,10 +720,10 @@ int main(int argc,char *argv[]) {
       ErrLog(errlog.sock,progname,logtxt);
 
       /* Processing and sending data */ 
-      OpsBuildPrm(prm,ptab,lags);    
+      OpsBuildPrm(prm,ptab,lagtab);    
       OpsBuildIQ(iq,&badtr);
       OpsBuildRaw(raw);
-      FitACF(prm,raw,fblk,fit);
+      if (pwronly==0) FitACF(prm,raw,fblk,fit);
       
       msg.num   = 0;
       msg.tsize = 0;
@@ -709,8 +740,12 @@ int main(int argc,char *argv[]) {
       tmpbuf=RawFlatten(raw,prm->nrang,prm->mplgs,&tmpsze);
       RMsgSndAdd(&msg,tmpsze,tmpbuf,RAW_TYPE,0); 
  
-      tmpbuf=FitFlatten(fit,prm->nrang,&tmpsze);
-      RMsgSndAdd(&msg,tmpsze,tmpbuf,FIT_TYPE,0); 
+      /* in the power-only mode the raw data, with just the power and
+         lag-0 (and lag-1) ACF, is the reduced product */
+      if (pwronly==0) {
+        tmpbuf=FitFlatten(fit,prm->nrang,&tmpsze);
+        RMsgSndAdd(&msg,tmpsze,tmpbuf,FIT_TYPE,0); 
+      }
 
       RMsgSndAdd(&msg,strlen(progname)+1,(unsigned char *) progname, NME_TYPE,0);   
      